@@ -0,0 +1,152 @@
+#include <SoftwareSerial.h>
+#include <EEPROM.h>
+
+#include "EEPROMStore.h"
+#include "SerialDebug.h"
+#include "Utils.h"
+
+#define SEQ_SIZE		2
+#define VERSION_SIZE	1
+#define HEADER_SIZE		(SEQ_SIZE + VERSION_SIZE)
+#define CRC_SIZE		1
+#define INVALID_SEQ		0xFFFF		//Erased cells
+
+void EEPROMStore::Initialize(int pStartAddress, int pEndAddress, byte pDataSize, byte pVersion)
+{
+	unsigned int seq;
+
+	FStartAddress = pStartAddress;
+	FDataSize = pDataSize;
+	FVersion = pVersion;
+	FSlotCount = (pEndAddress - pStartAddress) / (HEADER_SIZE + pDataSize + CRC_SIZE);
+	FValid = false;
+	FSlot = 0;
+	FSeq = 0;
+
+	//Look for the newest valid record, the scan is bounded by the slot count
+	for(byte i = 0; i < FSlotCount; i++)
+	{
+		if(!CheckSlot(i, &seq))
+			continue;
+
+		//Sequence numbers wrap around: newer means "ahead by less than half the range"
+		if(!FValid || ((seq != FSeq) && (((seq - FSeq) & 0xFFFF) < 0x8000)))
+		{
+			FValid = true;
+			FSlot = i;
+			FSeq = seq;
+		}
+	}
+
+	if(FValid)
+		DEBUG_P(PSTR("EEPROM Store Record %u at slot %d/%d"LB), FSeq, (int)FSlot, (int)FSlotCount);
+	else
+		DEBUG_P(PSTR("EEPROM Store Empty"LB));
+}
+
+int EEPROMStore::SlotAddress(byte pSlot)
+{
+	return FStartAddress + (int)pSlot * (HEADER_SIZE + FDataSize + CRC_SIZE);
+}
+
+boolean EEPROMStore::CheckSlot(byte pSlot, unsigned int *pSeq)
+{
+	int address = SlotAddress(pSlot);
+	byte crc = Crc8Update(0, FDataSize);		//A record of another size does not check either
+
+	//Records of another layout are not read, even if the CRC matches by chance
+	if(EEPROM.read(address + SEQ_SIZE) != FVersion)
+		return false;
+
+	for(byte i = 0; i < (HEADER_SIZE + FDataSize); i++)
+		crc = Crc8Update(crc, EEPROM.read(address + i));
+
+	*pSeq = EEPROM.read(address) | ((unsigned int)EEPROM.read(address + 1) << 8);
+
+	return (*pSeq != INVALID_SEQ) && (EEPROM.read(address + HEADER_SIZE + FDataSize) == crc);
+}
+
+boolean EEPROMStore::SameData(byte pSlot, const byte *pData)
+{
+	int address = SlotAddress(pSlot) + HEADER_SIZE;
+
+	for(byte i = 0; i < FDataSize; i++)
+		if(EEPROM.read(address + i) != pData[i])
+			return false;
+
+	return true;
+}
+
+void EEPROMStore::UpdateByte(int pAddress, byte pValue)
+{
+	//Do not wear cells that already hold the value
+	if(EEPROM.read(pAddress) != pValue)
+		EEPROM.write(pAddress, pValue);
+}
+
+boolean EEPROMStore::Read(void *pData)
+{
+	int address = SlotAddress(FSlot) + HEADER_SIZE;
+
+	if(!FValid)
+		return false;
+
+	for(byte i = 0; i < FDataSize; i++)
+		((byte *)pData)[i] = EEPROM.read(address + i);
+
+	return true;
+}
+
+boolean EEPROMStore::Write(const void *pData)
+{
+	const byte *data = (const byte *)pData;
+	byte slot = FSlot;
+	unsigned int seq = FSeq;
+
+	//Unchanged values are not written again
+	if(FValid && SameData(FSlot, data))
+		return true;
+
+	//Try every slot once, a worn out slot is skipped
+	for(byte tries = 0; tries < FSlotCount; tries++)
+	{
+		int address;
+		byte crc = Crc8Update(0, FDataSize);
+		unsigned int check;
+
+		slot = (FValid || tries) ? ((slot + 1) % FSlotCount) : 0;
+		seq++;
+		if(seq == INVALID_SEQ)
+			seq = 0;
+
+		address = SlotAddress(slot);
+
+		UpdateByte(address, seq & 0xFF);
+		UpdateByte(address + 1, seq >> 8);
+		crc = Crc8Update(crc, seq & 0xFF);
+		crc = Crc8Update(crc, seq >> 8);
+		UpdateByte(address + SEQ_SIZE, FVersion);
+		crc = Crc8Update(crc, FVersion);
+
+		for(byte i = 0; i < FDataSize; i++)
+		{
+			UpdateByte(address + HEADER_SIZE + i, data[i]);
+			crc = Crc8Update(crc, data[i]);
+		}
+
+		//The CRC is written last: until then the previous record is the valid one
+		UpdateByte(address + HEADER_SIZE + FDataSize, crc);
+
+		if(CheckSlot(slot, &check) && (check == seq) && SameData(slot, data))
+		{
+			FValid = true;
+			FSlot = slot;
+			FSeq = seq;
+			return true;
+		}
+
+		DEBUG_P(PSTR("** EEPROM Store Slot %d Failed"LB), (int)slot);
+	}
+
+	return false;
+}
@@ -0,0 +1,44 @@
+#ifndef __EEPROM_STORE
+#define __EEPROM_STORE
+#include "WProgram.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Append-only record store over an EEPROM region
+//
+//	The region is split in fixed size slots, each one holding a full record:
+//
+//	<seq lo><seq hi><version><data ... pDataSize bytes><CRC-8 of size, seq, version and data>
+//
+//	pVersion is the layout of the data: the caller changes it with the record
+//	layout, and records of any other version are ignored as if erased.
+//
+//	Every write goes to the slot after the last valid one, so writes are spread
+//	over the whole region. A torn write leaves the previous record valid.
+//	At boot the record with the highest sequence number is the current one.
+////////////////////////////////////////////////////////////////////////////////////
+class EEPROMStore
+{
+public:
+	void Initialize(int pStartAddress, int pEndAddress, byte pDataSize, byte pVersion);
+
+	boolean Read(void *pData);
+	boolean Write(const void *pData);
+
+	inline boolean IsEmpty() { return !FValid; };
+	inline unsigned int Sequence() { return FSeq; };
+protected:
+	int FStartAddress;
+	byte FSlotCount;
+	byte FDataSize;
+	byte FVersion;
+	byte FSlot;
+	unsigned int FSeq;
+	boolean FValid;
+
+	int SlotAddress(byte pSlot);
+	boolean CheckSlot(byte pSlot, unsigned int *pSeq);
+	boolean SameData(byte pSlot, const byte *pData);
+	void UpdateByte(int pAddress, byte pValue);
+};
+
+#endif
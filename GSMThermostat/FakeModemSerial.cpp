@@ -0,0 +1,491 @@
+#include <stdarg.h>
+#include <avr/pgmspace.h>
+
+#include "FakeModemSerial.h"
+#include "Utils.h"
+
+#define FAKE_SMS_STORED			0x3F	//Written by AT+CMGW, the text is not kept
+#define FAKE_SMS_READ			0x80
+#define FAKE_SMS_NEW			0x40	//Delivered, +CMTI not sent yet
+#define FAKE_SMS_SCRIPT_MASK	0x3F
+#define FAKE_URC_SMS			3		//Steps before are registration, signal and phonebook ready
+#define FAKE_NETWORK_DATE		"11/05/16"
+
+typedef struct _FakeSMS
+{
+	char phone[FAKE_MODEM_NUMBER_SIZE];
+	char body[FAKE_MODEM_BODY_SIZE];
+}TFakeSMS;
+
+//Incoming SMS, delivered in order once the phonebook is ready
+static const TFakeSMS FakeSMSScript[] PROGMEM =
+{
+	{FAKE_MODEM_OWNER, "ON 0000,22"},
+	{FAKE_MODEM_OWNER, "STATUS"},
+	{FAKE_MODEM_STRANGER, "ON 0000,30"},
+	{FAKE_MODEM_OWNER, "OFF 0000"}
+};
+
+#define FAKE_SMS_SCRIPT_COUNT	(sizeof(FakeSMSScript) / sizeof(FakeSMSScript[0]))
+
+#ifdef FAKE_MODEM
+FakeModemSerial FakeModem;
+#endif
+
+FakeModemSerial::FakeModemSerial()
+{
+	FCmdLen = 0;
+	FInBody = false;
+	FOffline = false;
+	FNewSMS = false;
+	FOutLen = 0;
+	FOutPos = 0;
+	FAnswerTS = 0;
+	FAnswerDelayMS = 0;
+	FListing = flNone;
+	FScriptNext = 0;
+	FMessageRef = 0;
+	FURCStep = 0xFF;
+	FHook = NULL;
+	FHookContext = NULL;
+
+	memset(FPBNumber, 0, sizeof(FPBNumber));
+	memset(FPBName, 0, sizeof(FPBName));
+	memset(FSMS, 0, sizeof(FSMS));
+
+	strcpy_P(FPBNumber[0], PSTR(FAKE_MODEM_OWNER));
+	strcpy_P(FPBName[0], PSTR("MAINPHONE"));
+}
+
+void FakeModemSerial::begin(long pBaud)
+{
+}
+
+void FakeModemSerial::end()
+{
+}
+
+int FakeModemSerial::available()
+{
+	//Nothing until the answer delay of the last command is over
+	if(FOffline || (SafeSub(millis(), FAnswerTS) < FAnswerDelayMS))
+		return 0;
+
+	if(FOutPos == FOutLen)
+	{
+		FOutPos = 0;
+		FOutLen = 0;
+
+		if(FListing != flNone)
+			NextListLine();
+		//URCs are not mixed with a command being received
+		else if(!FInBody && !FCmdLen && (FURCStep != 0xFF) && !AnnounceSMS() && FURCTS.IsExpired())
+			NextURC();
+	}
+
+	return FOutLen - FOutPos;
+}
+
+int FakeModemSerial::read()
+{
+	return available() ? FOut[FOutPos++] : -1;
+}
+
+int FakeModemSerial::peek()
+{
+	return available() ? FOut[FOutPos] : -1;
+}
+
+void FakeModemSerial::flush()
+{
+	FOutPos = FOutLen;
+	FListing = flNone;
+}
+
+void FakeModemSerial::write(uint8_t c)
+{
+	if(FOffline)
+		return;
+
+	if(FInBody)
+	{
+		if(c == 0x1A)			//CTRL+Z End of Message
+		{
+			byte slot;
+
+			FInBody = false;
+			FCmd[FCmdLen] = '\0';
+			FCmdLen = 0;
+
+			if((slot = StoreSMS()) && FHook)
+				FHook(FHookContext, feStored, slot, FCmd);
+		}
+		else if(c == 0x1B)		//ESC, aborted
+		{
+			FInBody = false;
+			FCmdLen = 0;
+		}
+		else if(FCmdLen < sizeof(FCmd) - 1)
+			FCmd[FCmdLen++] = c;
+		return;
+	}
+
+	if(c == '\r')
+	{
+		FCmd[FCmdLen] = '\0';
+		if(FCmdLen)
+			Execute();
+		FCmdLen = 0;
+	}
+	else if((c != '\n') && (FCmdLen < sizeof(FCmd) - 1))
+		FCmd[FCmdLen++] = c;
+}
+
+void FakeModemSerial::StopScript()
+{
+	FScriptNext = FAKE_SMS_SCRIPT_COUNT;
+}
+
+byte FakeModemSerial::Deliver(byte pScriptIndex)
+{
+	if(pScriptIndex >= FAKE_SMS_SCRIPT_COUNT)
+		return 0;
+
+	for(byte i = 0; i < FAKE_MODEM_SMS_SLOTS; i++)
+		if(!FSMS[i])
+		{
+			FSMS[i] = (pScriptIndex + 1) | FAKE_SMS_NEW;
+			FNewSMS = true;
+			return i + 1;
+		}
+
+	return 0;
+}
+
+byte FakeModemSerial::ScriptCount()
+{
+	return FAKE_SMS_SCRIPT_COUNT;
+}
+
+void FakeModemSerial::ScriptSMS(byte pIndex, char *pPhone, char *pBody)
+{
+	TFakeSMS sms;
+
+	memcpy_P(&sms, &FakeSMSScript[pIndex], sizeof(sms));
+	strcpy(pPhone, sms.phone);
+	strcpy(pBody, sms.body);
+}
+
+void FakeModemSerial::SetOffline(boolean pOffline)
+{
+	if(pOffline == FOffline)
+		return;
+
+	FOffline = pOffline;
+
+	//What was being sent or received is lost, the SMS memory is kept (SIM)
+	FInBody = false;
+	FCmdLen = 0;
+	FOutLen = 0;
+	FOutPos = 0;
+	FListing = flNone;
+	FURCStep = 0xFF;
+}
+
+void FakeModemSerial::SetHook(THook pHook, void *pContext)
+{
+	FHook = pHook;
+	FHookContext = pContext;
+}
+
+void FakeModemSerial::Execute()
+{
+	char number[FAKE_MODEM_NUMBER_SIZE];
+	char name[FAKE_MODEM_NAME_SIZE];
+	int a;
+	int b;
+	int n;
+
+	Answer(FAKE_MODEM_ANSWER_MS);
+
+	//Init sequence after a power on: registration and phonebook are announced
+	if(strncmp_P(FCmd, PSTR("ATE0"), 4) == 0)
+	{
+		if(FURCStep == 0xFF)
+		{
+			FURCStep = 0;
+			FURCTS.Set(FAKE_MODEM_URC_MS);
+		}
+		Ok();
+	}
+	else if(strcmp_P(FCmd, PSTR("AT+CPWROFF")) == 0)
+	{
+		FURCStep = 0xFF;
+		Ok();
+	}
+	else if(strcmp_P(FCmd, PSTR("AT+CREG?")) == 0)
+	{
+		//Searching until the registration URC
+		Line(PSTR("+CREG: 1,%d"), ((FURCStep == 0xFF) || (FURCStep == 0)) ? 2 : 1);
+		Ok();
+	}
+	else if(strcmp_P(FCmd, PSTR("AT+CPBR=?")) == 0)
+	{
+		Line(PSTR("+CPBR: (1-%d),%d,%d"), FAKE_MODEM_PB_SIZE, FAKE_MODEM_NUMBER_SIZE - 1, FAKE_MODEM_NAME_SIZE - 1);
+		Ok();
+	}
+	else if(sscanf_P(FCmd, PSTR("AT+CPBR=%d,%d"), &a, &b) == 2)
+	{
+		//Entries are listed by available(), one line at a time
+		FListing = flPBRead;
+		FListFound = false;
+		FListNext = (a < 1) ? 1 : a;
+		FListLast = (b > FAKE_MODEM_PB_SIZE) ? FAKE_MODEM_PB_SIZE : b;
+	}
+	else if(sscanf_P(FCmd, PSTR("AT+CPBF=\"%11[^\"]\""), FListName) == 1)
+	{
+		FListing = flPBFind;
+		FListFound = false;
+		FListNext = 1;
+		FListLast = FAKE_MODEM_PB_SIZE;
+	}
+	else if(strncmp_P(FCmd, PSTR("AT+CPBW="), 8) == 0)
+	{
+		number[0] = '\0';
+		name[0] = '\0';
+
+		//No number: the entry is deleted
+		n = sscanf_P(FCmd, PSTR("AT+CPBW=%d,\"%20[^\"]\",,\"%11[^\"]\""), &a, number, name);
+		if((n < 1) || (a < 1) || (a > FAKE_MODEM_PB_SIZE))
+			Line(PSTR("+CME ERROR: 21"));
+		else
+		{
+			strcpy(FPBNumber[a - 1], number);
+			strcpy(FPBName[a - 1], name);
+			Ok();
+		}
+	}
+	else if(strncmp_P(FCmd, PSTR("AT+CMGW="), 8) == 0)
+	{
+		//Prompt, the text follows up to CTRL+Z
+		FInBody = true;
+		strcpy_P(FOut, PSTR("\r\n> "));
+		FOutLen = 4;
+	}
+	else if(sscanf_P(FCmd, PSTR("AT+CMSS=%d"), &a) == 1)
+	{
+		if(IsStored(a))
+		{
+			Answer(FAKE_MODEM_SEND_MS);
+			Line(PSTR("+CMSS: %d"), ++FMessageRef);
+			Ok();
+
+			if(FHook)
+				FHook(FHookContext, feSent, a, NULL);
+		}
+		else
+			Line(PSTR("+CMS ERROR: 321"));
+	}
+	else if(sscanf_P(FCmd, PSTR("AT+CMGR=%d"), &a) == 1)
+	{
+		if(!IsStored(a))
+			Line(PSTR("+CMS ERROR: 321"));
+		else if(FSMS[a - 1] == FAKE_SMS_STORED)
+		{
+			Line(PSTR("+CMGR: \"STO UNSENT\",\"\",\r\n"));
+			Ok();
+		}
+		else
+		{
+			TFakeSMS sms;
+
+			memcpy_P(&sms, &FakeSMSScript[(FSMS[a - 1] & FAKE_SMS_SCRIPT_MASK) - 1], sizeof(sms));
+
+			if(FSMS[a - 1] & FAKE_SMS_READ)
+				Line(PSTR("+CMGR: \"REC READ\",\"%s\",,\"" FAKE_NETWORK_DATE ",08:00:00+04\"\r\n%s"), sms.phone, sms.body);
+			else
+				Line(PSTR("+CMGR: \"REC UNREAD\",\"%s\",,\"" FAKE_NETWORK_DATE ",08:00:00+04\"\r\n%s"), sms.phone, sms.body);
+			Ok();
+
+			if(!(FSMS[a - 1] & FAKE_SMS_READ) && FHook)
+				FHook(FHookContext, feRead, a, NULL);
+			FSMS[a - 1] |= FAKE_SMS_READ;
+		}
+	}
+	else if((n = sscanf_P(FCmd, PSTR("AT+CMGD=%d,%d"), &a, &b)) >= 1)
+	{
+		//Flag 4 deletes all, the other flags delete the read ones
+		for(byte i = 0; i < FAKE_MODEM_SMS_SLOTS; i++)
+			if((n == 1) ? (i == a - 1) : ((b == 4) || (FSMS[i] & FAKE_SMS_READ)))
+				FSMS[i] = 0;
+		Ok();
+	}
+	else if(strcmp_P(FCmd, PSTR("AT+CCLK?")) == 0)
+	{
+		unsigned long minutes = millis() / 60000;
+
+		//The day does not change, the time starts at 08:00
+		Line(PSTR("+CCLK: \"" FAKE_NETWORK_DATE ",%02d:%02d:00+04\""), (int)((8 + minutes / 60) % 24), (int)(minutes % 60));
+		Ok();
+	}
+	else if(strncmp_P(FCmd, PSTR("AT+USOCR="), 9) == 0)
+	{
+		Line(PSTR("+USOCR: 0"));
+		Ok();
+	}
+	else if(sscanf_P(FCmd, PSTR("AT+USOWR=%d,%d"), &a, &b) == 2)
+	{
+		Line(PSTR("+USOWR: %d,%d"), a, b);
+		Ok();
+	}
+	else if((strncmp_P(FCmd, PSTR("AT+UPSDA="), 9) == 0) || (strncmp_P(FCmd, PSTR("AT+USOCO="), 9) == 0))
+	{
+		//GPRS attach and TCP connect
+		Answer(FAKE_MODEM_SOCKET_MS);
+		Ok();
+	}
+	else
+		Ok();
+}
+
+byte FakeModemSerial::StoreSMS()
+{
+	Answer(FAKE_MODEM_STORE_MS);
+
+	for(byte i = 0; i < FAKE_MODEM_SMS_SLOTS; i++)
+		if(!FSMS[i])
+		{
+			FSMS[i] = FAKE_SMS_STORED;
+			Line(PSTR("+CMGW: %d"), i + 1);
+			Ok();
+			return i + 1;
+		}
+
+	//Memory full
+	Line(PSTR("+CMS ERROR: 322"));
+	return 0;
+}
+
+boolean FakeModemSerial::IsStored(int pIndex)
+{
+	return (pIndex >= 1) && (pIndex <= FAKE_MODEM_SMS_SLOTS) && FSMS[pIndex - 1];
+}
+
+void FakeModemSerial::NextListLine()
+{
+	for(; FListNext <= FListLast; FListNext++)
+	{
+		byte i = FListNext - 1;
+
+		if(FPBNumber[i][0] && ((FListing == flPBRead) || (strncmp(FPBName[i], FListName, strlen(FListName)) == 0)))
+		{
+			if(FListing == flPBRead)
+				Line(PSTR("+CPBR: %d,\"%s\",145,\"%s\""), (int)FListNext, FPBNumber[i], FPBName[i]);
+			else
+				Line(PSTR("+CPBF: %d,\"%s\",145,\"%s\""), (int)FListNext, FPBNumber[i], FPBName[i]);
+
+			FListNext++;
+			FListFound = true;
+			return;
+		}
+	}
+
+	//No entry found by name
+	if((FListing == flPBFind) && !FListFound)
+		Line(PSTR("+CME ERROR: 22"));
+	else
+		Ok();
+
+	FListing = flNone;
+}
+
+void FakeModemSerial::NextURC()
+{
+	switch(FURCStep)
+	{
+		case 0:
+			Line(PSTR("+CREG: 1"));
+			break;
+		case 1:
+			Line(PSTR("+CIEV: 2,4"));
+			break;
+		case 2:
+			Line(PSTR("+PBREADY"));
+			FURCTS.Set(FAKE_MODEM_SMS_INTERVAL_MS);
+			break;
+		default:
+		{
+			if(FScriptNext == FAKE_SMS_SCRIPT_COUNT)
+				return;
+
+			//Stored by the network in the first free slot, not delivered while the memory is full
+			for(byte i = 0; i < FAKE_MODEM_SMS_SLOTS; i++)
+				if(!FSMS[i])
+				{
+					FSMS[i] = ++FScriptNext;
+					Line(PSTR("+CMTI: \"SM\",%d"), i + 1);
+					break;
+				}
+		}
+	}
+
+	if(FURCStep < FAKE_URC_SMS)
+		FURCStep++;
+	FURCTS.Reset();
+}
+
+//+CMTI of the first SMS delivered by Deliver() and not announced yet, once the phonebook is ready
+boolean FakeModemSerial::AnnounceSMS()
+{
+	if(!FNewSMS || (FURCStep < FAKE_URC_SMS))
+		return false;
+
+	for(byte i = 0; i < FAKE_MODEM_SMS_SLOTS; i++)
+		if(FSMS[i] & FAKE_SMS_NEW)
+		{
+			FSMS[i] &= ~FAKE_SMS_NEW;
+			Line(PSTR("+CMTI: \"SM\",%d"), i + 1);
+			return true;
+		}
+
+	FNewSMS = false;
+	return false;
+}
+
+//Starts a new answer, sent pDelayMS from now
+void FakeModemSerial::Answer(unsigned int pDelayMS)
+{
+	FOutLen = 0;
+	FOutPos = 0;
+	FListing = flNone;
+	FAnswerTS = millis();
+	FAnswerDelayMS = pDelayMS;
+}
+
+//Appends <CR><LF><text><CR><LF> to the answer, pFmt is in PROGMEM. The text is truncated to fit
+void FakeModemSerial::Line(const char *pFmt, ...)
+{
+	va_list arglist;
+	int room;
+	int len;
+
+	if(FOutLen > sizeof(FOut) - 4)
+		return;
+
+	FOut[FOutLen++] = '\r';
+	FOut[FOutLen++] = '\n';
+
+	room = sizeof(FOut) - FOutLen - 2;
+	va_start(arglist, pFmt);
+	len = vsnprintf_P(FOut + FOutLen, room + 1, pFmt, arglist);
+	va_end(arglist);
+	FOutLen += (len > room) ? room : len;
+
+	FOut[FOutLen++] = '\r';
+	FOut[FOutLen++] = '\n';
+}
+
+void FakeModemSerial::Ok()
+{
+	Line(PSTR("OK"));
+}
@@ -0,0 +1,106 @@
+#ifndef __FAKE_MODEM_SERIAL
+#define __FAKE_MODEM_SERIAL
+
+#include "WProgram.h"
+#include "Timeout.h"
+#include "PinConfig.h"
+
+#define FAKE_MODEM_CMD_SIZE			56		//Longer commands are truncated (AT+USOWR hex data)
+#define FAKE_MODEM_OUT_SIZE			96		//One answer, listings are generated a line at a time
+#define FAKE_MODEM_NUMBER_SIZE		21
+#define FAKE_MODEM_NAME_SIZE		12
+#define FAKE_MODEM_BODY_SIZE		16		//Scripted SMS text
+#define FAKE_MODEM_PB_SIZE			5
+#define FAKE_MODEM_SMS_SLOTS		10
+#define FAKE_MODEM_ANSWER_MS		20
+#define FAKE_MODEM_STORE_MS			500		//AT+CMGW
+#define FAKE_MODEM_SEND_MS			3000	//AT+CMSS, network round trip
+#define FAKE_MODEM_SOCKET_MS		1000	//AT+UPSDA, AT+USOCO
+#define FAKE_MODEM_URC_MS			1000	//Registration, signal and phonebook ready after the init sequence
+#define FAKE_MODEM_SMS_INTERVAL_MS	((unsigned long)1000*60)
+#define FAKE_MODEM_OWNER			"+390000000000"		//In the phonebook as MAINPHONE
+#define FAKE_MODEM_STRANGER			"+390000000001"		//Not in the phonebook
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Scripted modem on the ModemGSMBase serial port type, for bench tests without
+//	a modem or a SIM. It answers the AT commands sent by ModemGSM from a small
+//	phonebook and SMS memory kept in RAM, with a delay per command class. After
+//	the init sequence it posts the registration, signal and phonebook ready URCs,
+//	then one scripted incoming SMS per FAKE_MODEM_SMS_INTERVAL_MS.
+//	Echo is always off. Select it with FAKE_MODEM in PinConfig.h
+//
+//	A test driver (tools/host FleetSim) can deliver SMS of the script at any
+//	time, take the modem offline and follow the SMS through the hook: read by
+//	the sketch, answer stored (with its first FAKE_MODEM_CMD_SIZE - 1 chars)
+//	and sent
+////////////////////////////////////////////////////////////////////////////////////
+class FakeModemSerial : public Print
+{
+	typedef enum _Listing {flNone, flPBRead, flPBFind} EListing;
+public:
+	typedef enum _Event {feRead, feStored, feSent} EEvent;
+	typedef void (*THook)(void *pContext, byte pEvent, byte pSlot, const char *pText);
+
+	FakeModemSerial();
+
+	void begin(long pBaud);
+	void end();
+	int available();
+	int read();
+	int peek();
+	void flush();
+	virtual void write(uint8_t c);
+
+	//No more scripted SMS, for bench runs that must not be disturbed by commands
+	void StopScript();
+
+	//SMS pScriptIndex received by the network: stored and announced when the modem is idle.
+	//Returns the slot, 0 when the SMS memory is full (the SMS is lost)
+	byte Deliver(byte pScriptIndex);
+	byte ScriptCount();
+	void ScriptSMS(byte pIndex, char *pPhone, char *pBody);
+	//Offline the modem does not answer. It comes back from a restart: init sequence, then the URCs
+	void SetOffline(boolean pOffline);
+	void SetHook(THook pHook, void *pContext);
+protected:
+	char FCmd[FAKE_MODEM_CMD_SIZE];
+	byte FCmdLen;
+	boolean FInBody;					//AT+CMGW text, up to CTRL+Z, kept in FCmd for the hook
+	boolean FOffline;
+	boolean FNewSMS;					//Deliver() since the last AnnounceSMS() that found none
+	char FOut[FAKE_MODEM_OUT_SIZE];
+	byte FOutLen;
+	byte FOutPos;
+	unsigned long FAnswerTS;
+	unsigned int FAnswerDelayMS;
+	byte FListing;
+	byte FListNext;
+	byte FListLast;
+	boolean FListFound;
+	char FListName[FAKE_MODEM_NAME_SIZE];
+	char FPBNumber[FAKE_MODEM_PB_SIZE][FAKE_MODEM_NUMBER_SIZE];	//"" = free
+	char FPBName[FAKE_MODEM_PB_SIZE][FAKE_MODEM_NAME_SIZE];
+	byte FSMS[FAKE_MODEM_SMS_SLOTS];	//0 = free, FAKE_SMS_STORED or script index + 1 (FAKE_SMS_NEW until announced, FAKE_SMS_READ once read)
+	byte FScriptNext;
+	byte FMessageRef;
+	byte FURCStep;						//0xFF = script not started
+	Timeout FURCTS;
+	THook FHook;
+	void *FHookContext;
+
+	void Execute();
+	byte StoreSMS();
+	boolean IsStored(int pIndex);
+	void NextListLine();
+	void NextURC();
+	boolean AnnounceSMS();
+	void Answer(unsigned int pDelayMS);
+	void Line(const char *pFmt, ...);
+	void Ok();
+};
+
+#ifdef FAKE_MODEM
+extern FakeModemSerial FakeModem;
+#endif
+
+#endif
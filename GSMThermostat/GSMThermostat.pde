@@ -3,19 +3,28 @@
 //	Hardware: 
 //		Arduino Uno
 //		Shield Dualband Libellium (Modem GSG DavisComm DS3500)
-//		Temperature Sensor AD22100
+//		Temperature Sensor AD22100 or DS18B20 (TEMP_SENSOR_CLASS in PinConfig.h)
 //		Relais Latched dual coil Omron G6CK-1117P-US 5DC
+//		One sensor and one relais per zone (ZONE_COUNT in PinConfig.h)
 //
 //	Recognized commands:
 //
 //	REGISTER <Pin 4 digits>
 //	UNREGISTER <Pin 4 digits>
 //	CHPIN <old Pin 4 digits> , <new Pin 4 digits>
-//  ON <Pin 4 digits> , <Temperature>
-//  OFF <Pin 4 digits>
+//  ON <Pin 4 digits> , <Temperature> [, <Zone>]
+//  OFF <Pin 4 digits> [, <Zone>]
 //  MAINPHONE <Pin 4 digits>, <Y | N>
 //  STATUS
 //	RESET <Pin 4 digits>
+//	HISTORY <Pin 4 digits>
+//	SCHED <Pin 4 digits> [, <Day> [, <hh:mm>-<hh:mm> , <Temperature> | , CLEAR]]
+//	MODE <Pin 4 digits> , <H | P>
+//	DIAG <Pin 4 digits>
+//
+//	Several commands can be sent in one SMS, separated by ';' or new lines,
+//	eg "ON 1234,20; MAINPHONE 1234,Y; STATUS". They are executed in order and 
+//	answered with a single SMS.
 //
 ////////////////////////////////////////////////////////////////////////////////////
 
@@ -28,11 +37,23 @@
 #include "WProgram.h"
 #include "ModemGSM.h"
 #include "SerialDebug.h"
+#include "TempSensor.h"
 #include "TempSensor_AD22100.h"
+#include "TempSensor_DS18B20.h"
+#include "TempSensor_Sim.h"
 #include "Utils.h"
 #include "Timeout.h"
 #include "LatchedRelais.h"
 #include "PinConfig.h"
+#include "EEPROMStore.h"
+#include "TempHistory.h"
+#include "WeekSchedule.h"
+#include "PIController.h"
+#include "MemoryInfo.h"
+#include "ScratchArena.h"
+#include "ReplyWriter.h"
+#include "SenderFilter.h"
+#include "Profile.h"
 
 #include <EEPROM.h>
 
@@ -42,19 +63,33 @@
 #define STABLE_TEMPERATURE_INTERVAL_MS      15000		//Temperature must be stable for this time to trigger changes
 #define TEMP_MIN                            5.0			//"ON" command min temperature
 #define TEMP_MAX                            28.0		//"ON" command max temperature
+#define CONTROL_HYSTERESIS					0			//Control mode: +/- HALF_DELTA_TEMP on/off
+#define CONTROL_PI							1			//Control mode: time proportioning PI
 #define MAX_ON_INTERVAL_DAYS				3			//Periodo massimo per cui il termostato resta attivo, alla fine del periodo passa automaticamente a OFF	
 
-#define PIN_EEPROM_START_ADDRESS			1			//Pin EEPROM first address
+#define PIN_EEPROM_START_ADDRESS			1			//Pin EEPROM first address (before the state store, read once for migration)
+#define STATE_EEPROM_START_ADDRESS			32			//State store EEPROM first address
+#define STATE_EEPROM_END_ADDRESS			SCHED_EEPROM_START_ADDRESS	//State store EEPROM end address (excluded)
+#define SCHED_EEPROM_START_ADDRESS			(E2END + 1 - SCHED_EEPROM_SIZE)	//Weekly schedule at the end of the EEPROM
+#define CLOCK_SYNC_INTERVAL_MS				((unsigned long)1000*60*60*6)	//Network clock read interval
+#define CLOCK_RETRY_INTERVAL_MS				((unsigned long)1000*60*5)		//Network clock read retry interval
+#define STATE_SAVE_INTERVAL_MS				((unsigned long)1000*60*15)	//ON period progress save interval
 #define DEFAULT_PIN							"0000"		//Default Pin if not programmed
 #define MAX_COMMAND_LEN						80			//Max SMS Text Command length
 #define MAX_RESET_MESSAGE_COUNT				4			//Number of Soft Reset Messages
+#define MODEM_RECOVERY_ATTEMPTS				3			//Staged modem recoveries before the modem is given up
+#define MODEM_RECOVERY_RETRY_MS				((unsigned long)1000*60*10)	//Modem given up: next recovery (no watchdog)
 #define DEBUG_INFO_INTERVAL_MS				30000		//Debug info interval
+#define SCHED_ZONE							0			//Zone following the weekly schedule and recorded by the history
+
+//Zone state, one entry per zone
+boolean Active[ZONE_COUNT];								//Thermostat function status
+float TempSet[ZONE_COUNT];								//"ON" command temperature
+float LastTemp[ZONE_COUNT];								//Last temperature reading
+boolean SendOnceTempOK[ZONE_COUNT];						//Send a temperature OK SMS once
+char ONCommandPhone[ZONE_COUNT][PHONE_NUMBER_BUFFER_SIZE];	//On Command Phone number source
 
-boolean Active;											//Thermostat function status
-float TempSet;											//"ON" command temperature
-float LastTemp;											//Last temperature reading
-boolean SendOnceTempOK;									//Send a temperature OK SMS once
-char ONCommandPhone[PHONE_NUMBER_BUFFER_SIZE];			//On Command Phone number source
+byte ControlMode;										//CONTROL_HYSTERESIS or CONTROL_PI
 char Pin[5];											//Pin 4 digits + \0
 
 bool PowerOnMessageSent;								//Power On SMS already sent
@@ -62,57 +97,404 @@ bool ResetMessagePending;								//True if a Informational Soft Reset SMS is to
 bool ResetCommandMessagePending;						//True if a Informational User Reset SMS is to be sent
 byte ResetMessageAvail;									//Counter for Soft Reset messages
 
+//Thermostat state saved in EEPROM, restored at boot
+typedef struct _ZoneState
+{
+	byte active;
+	int tempSet;										//Tenths of degree
+	unsigned int onMinutes;								//Minutes elapsed since the ON command
+	char phone[PHONE_NUMBER_BUFFER_SIZE - 1];			//ON command phone number, not terminated
+}TZoneState;
+
+//Stored with the record, change it with the layout of TThermostatState: records of another layout are ignored
+#define STATE_LAYOUT_VERSION	1
+
+typedef struct _ThermostatState
+{
+	char pin[4];
+	TZoneState zone[ZONE_COUNT];
+	byte controlMode;
+}TThermostatState;
+
+EEPROMStore StateStore;
+Timeout StateSaveTS;
+
+//Boot phases, ms from power on. 0 means phase not reached yet
+typedef enum _BootPhase {bpControl, bpModemReady, bpRegistered, bpPBReady, bpSMSReady, bpCount} EBootPhase;
+unsigned long BootPhaseMS[bpCount];
+
 Timeout TempDebug;
-Timeout TempInterval;									
-Timeout OnCommandTS;									//On Command timestamp to calculate auto off timeout
+Timeout TempInterval[ZONE_COUNT];									
+Timeout OnCommandTS[ZONE_COUNT];						//On Command timestamp to calculate auto off timeout
+
+//Status snapshot, updated as the loop goes: STATUS formats it without sensor or modem I/O
+#define ZONE_STATUS_ACTIVE		0x01
+#define ZONE_STATUS_RELAIS		0x02
+#define ZONE_STATUS_FAILED		0x04
+
+typedef struct _ZoneStatus
+{
+	byte flags;											//ZONE_STATUS_xxx
+	int temp;											//Tenths of degree
+	int tempSet;										//Tenths of degree
+	unsigned int offMinutes;							//Minutes left before the auto OFF
+}TZoneStatus;
+
+typedef struct _Status
+{
+	TZoneStatus zone[ZONE_COUNT];
+	byte signalLevel;
+	byte smsIn;											//SMS queue depths
+	byte smsOut;
+	unsigned long uptime;								//Seconds, does not wrap with millis()
+	byte resetCount;									//Modem error recoveries since power on
+	byte lastError;										//Recovery stage of the last modem error
+	unsigned long lastErrorUptime;						//Seconds
+}TStatus;
+
+TStatus Status;
+Timeout UptimeTS;
+
+//GPRS telemetry (ModemConfig::TelemetryBufferSize not 0 and MODEM_UBLOX): a status frame per sample interval,
+//payload <uptime s 4> <signal> <sms in> <sms out> <resets> <failed sends 2> then per zone <temp 2> <set 2> <flags>
+#define TELEMETRY_SAMPLE_INTERVAL_MS		((unsigned long)1000*60*5)
+#define TELEMETRY_FRAME_STATUS				1
+#define TELEMETRY_STATUS_LEN				(10 + 5 * ZONE_COUNT)
+
+Timeout TelemetryTS;
 
 ModemGSM GSMModem;										//GSM Modem
-TempSensorAD22100 TSense;								//Temperature Sensor AD22100
-LatchedRelais Relais;									//Latched Relais (dual coil)  
+TempSensorArray<TEMP_SENSOR_CLASS, ZONE_COUNT> TSense;	//Temperature Sensors, one per zone
+LatchedRelais Relais[ZONE_COUNT];						//Latched Relais (dual coil)  
+PIController PIControl[ZONE_COUNT];					//PI control mode
+TempHistory History;									//Temperature and relais history
+WeekSchedule Schedule;									//Weekly setpoint schedule
+Timeout ClockSyncTS;									//Network clock read timestamp
+Timeout ModemRetryTS;									//Modem recovery retry after the attempts failed
+boolean ModemGivenUp;									//RecoverModem() attempts failed, retried on ModemRetryTS
+SenderFilter Senders;									//Incoming SMS rate limit and unknown numbers cache
 
 #define MAX_ON_INTERVAL_MS ((unsigned long)1000*60*60*24*MAX_ON_INTERVAL_DAYS)		//Timeout in milliseconds
 #define MAINPHONE_PB_ENTRY "MAINPHONE"
-#define MAX_COMMAND_ANSWER_LEN (MAX_COMMAND_LEN + 61)
+#define COMMAND_DONE 0
+#define COMMAND_IGNORED 1
+#define COMMAND_RESET 2
+#define INFO_MESSAGE_LEN 61
+#define ZONE_TAG_LEN 5
+#define ZONE_MESSAGE_LEN 60
+#define DEBUG_INFO_LEN 75
+
+void InitState()
+{
+	TThermostatState state;
+
+	StateStore.Initialize(STATE_EEPROM_START_ADDRESS, STATE_EEPROM_END_ADDRESS, sizeof(state), STATE_LAYOUT_VERSION);
+
+	if(!StateStore.Read(&state))
+	{
+		//After erasing EEPROM cells contain 0xFF
+		if(EEPROM.read(PIN_EEPROM_START_ADDRESS) == 0xFF)
+		{
+			//Set default Pin
+			strcpy_P(Pin, PSTR(DEFAULT_PIN));
+			DEBUG_P(PSTR("Pin Initialized to " DEFAULT_PIN LB));
+		}
+		else
+		{
+			//Keep the Pin programmed by older firmware
+			for(int i = 0; i < (sizeof(Pin) - 1); i++)
+				Pin[i] = EEPROM.read(i +  PIN_EEPROM_START_ADDRESS);
+			Pin[sizeof(Pin) - 1] = '\0';
+			DEBUG_P(PSTR("Pin Migrated --> %s"LB), Pin);
+		}
+
+		for(byte z = 0; z < ZONE_COUNT; z++)
+			Active[z] = false;
+
+		ControlMode = CONTROL_HYSTERESIS;
+		SaveState();
+		return;
+	}
+
+	memcpy(Pin, state.pin, sizeof(Pin) - 1);
+	Pin[sizeof(Pin) - 1] = '\0';
+	DEBUG_P(PSTR("Pin --> %s"LB), Pin);
+
+	ControlMode = (state.controlMode == CONTROL_PI) ? CONTROL_PI : CONTROL_HYSTERESIS;
+
+	for(byte z = 0; z < ZONE_COUNT; z++)
+	{
+		TZoneState *zone = &state.zone[z];
+		char temp[10];
+
+		if(!(Active[z] = zone->active))
+			continue;
 
-void InitPin()
+		TempSet[z] = zone->tempSet / 10.0;
+
+		memcpy(ONCommandPhone[z], zone->phone, sizeof(zone->phone));
+		ONCommandPhone[z][sizeof(zone->phone)] = '\0';
+
+		//Auto heater power off continues from where it was
+		OnCommandTS[z].SetElapsed((unsigned long)zone->onMinutes * 60000);
+		TempInterval[z].Reset();
+		SendOnceTempOK[z] = false;
+
+		dtostrf(TempSet[z], 1, 1, temp);
+		DEBUG_P(PSTR("State Restored --> Zone %d ON [%s C] since %u min"LB), (int)z + 1, temp, zone->onMinutes);
+	}
+
+	UpdateLeds();
+}
+
+void SaveState()
 {
-	//After erasing EEPROM cells contain 0xFF
-	if(EEPROM.read(PIN_EEPROM_START_ADDRESS) == 0xFF)
+	TThermostatState state;
+
+	memset(&state, 0, sizeof(state));
+	memcpy(state.pin, Pin, sizeof(state.pin));
+	state.controlMode = ControlMode;
+
+	for(byte z = 0; z < ZONE_COUNT; z++)
 	{
-		//Set default Pin
-		strcpy_P(Pin, PSTR(DEFAULT_PIN));
-		WritePinToEEPROM();
-		DEBUG_P(PSTR("Pin Initialized to " DEFAULT_PIN LB));
+		TZoneState *zone = &state.zone[z];
+
+		if(zone->active = Active[z])
+		{
+			zone->tempSet = (int)(TempSet[z] * 10 + 0.5);
+			zone->onMinutes = OnCommandTS[z].Elapsed() / 60000;
+			strncpy(zone->phone, ONCommandPhone[z], sizeof(zone->phone));
+		}
 	}
-	else
+
+	StateSaveTS.Reset();
+
+	//Unchanged state is not written
+	if(!StateStore.Write(&state))
+		DEBUG_P(PSTR("** State Save FAIL"LB));
+}
+
+
+void UpdateLeds()
+{
+	boolean active = false;
+	boolean set = false;
+
+	//LEDs show whether any zone is active or heating
+	for(byte z = 0; z < ZONE_COUNT; z++)
 	{
-		//Read the Pin from EEPROM
-		ReadPinFromEEPROM();
-		DEBUG_P(PSTR("Pin --> %s"LB), Pin);
-		//DEBUGLN(Pin);
+		active |= Active[z];
+		set |= Relais[z].IsSet();
 	}
+
+	digitalWrite(PIN_LED_ACTIVE, active ? HIGH : LOW);
+	digitalWrite(PIN_LED_RELAIS_SET, set ? HIGH : LOW);
+}
+
+//Zone prefix for SMS texts, empty with a single zone
+void ZoneTag(char *pDest, byte pZone)
+{
+	ReplyWriter tag(pDest, ZONE_TAG_LEN);
+
+	if(ZONE_COUNT > 1)
+		tag.Char('Z').Int(pZone + 1).Char(' ');
 }
 
+//RAM usage: static, free now and never used since boot (stack high water mark), heap
+void FormatMemoryInfo(ReplyWriter *pReply)
+{
+	TMemoryInfo info;
+	ReplyWriter &reply = *pReply;
+
+	GetMemoryInfo(&info);
+
+	reply.Str_P(PSTR("RAM ")).Int(info.staticRam).Str_P(PSTR(" Free ")).Int(info.freeRam).Str_P(PSTR(" Min ")).Int(info.stackUnused);
+	reply.Str_P(PSTR("\nHeap ")).Int(info.heapUsed).Str_P(PSTR(" Free ")).Int(info.heapFree).Str_P(PSTR(" Max ")).Int(info.heapLargest);
+	reply.Str_P(PSTR("\nScratch ")).Int(Scratch.HighWater()).Char('/').Int(SCRATCH_ARENA_SIZE);
+}
+
+void MarkBootPhase(byte pPhase)
+{
+	unsigned long ts;
+
+	//Record the first time only
+	if(BootPhaseMS[pPhase] != 0)
+		return;
+
+	ts = millis();
+	BootPhaseMS[pPhase] = (ts ? ts : 1);
+
+	DEBUG_P(PSTR("Boot Phase %d --> %lu ms"LB), (int)pPhase, BootPhaseMS[pPhase]);
+}
+
+double MakeTemperature(int pIntPart, int pDecPart, boolean pHasDecPart)
+{
+	double res;
+
+	//if there are no decimals the temperature is and integer number
+	if(!pHasDecPart)
+		return pIntPart;
+
+	res = pDecPart;
+             
+	//divide for 10 until < 1
+	for(;res >= 1; res /= 10);
+            
+	return res + pIntPart;   
+}
+
+void SyncClock()
+{
+	byte day;
+	byte hour;
+	byte minute;
+
+	if(GSMModem.GetNetworkTime(&day, &hour, &minute))
+	{
+		Schedule.SetClock(day, hour, minute);
+		ClockSyncTS.Set(CLOCK_SYNC_INTERVAL_MS);
+	}
+	else
+		ClockSyncTS.Set(CLOCK_RETRY_INTERVAL_MS);
+}
+
+void ApplySchedule()
+{
+	byte setpoint = Schedule.CurrentSetpoint();
+	char temp[10];
+
+	if(setpoint == 0)
+	{
+		DEBUG_P(PSTR("Schedule --> OFF"LB));
+
+		if(Active[SCHED_ZONE])
+			HandleOff(SCHED_ZONE);
+		return;
+	}
+
+	TempSet[SCHED_ZONE] = WeekSchedule::SetpointToCelsius(setpoint);
+
+	if(!Active[SCHED_ZONE])
+	{
+		Active[SCHED_ZONE] = true;
+		UpdateLeds();
+
+		//Stable temperature timeout initialization
+		TempInterval[SCHED_ZONE].Reset();
+		SendOnceTempOK[SCHED_ZONE] = false;
+		PIControl[SCHED_ZONE].Reset(Relais[SCHED_ZONE].IsSet(), LastTemp[SCHED_ZONE]);
+	}
+
+	//Auto heater power off timeout restarts on every scheduled change
+	OnCommandTS[SCHED_ZONE].Reset();
+	SaveState();
+
+	dtostrf(TempSet[SCHED_ZONE], 1, 1, temp);
+	DEBUG_P(PSTR("Schedule --> ON [%s C]"LB), temp);
+}
 
 void SendInformationalSMS(const prog_char *pMessage)
 {
-	char number[PHONE_NUMBER_BUFFER_SIZE];
-	char msg[61];
+	ScratchScope scratch;
+	char *number = scratch.Alloc(PHONE_NUMBER_BUFFER_SIZE);
+	char *msg = scratch.Alloc(INFO_MESSAGE_LEN);
+
+	if(!msg)
+		return;
 
 	if(GSMModem.GetPBEntryByName(MAINPHONE_PB_ENTRY, number, NULL))
 	{
-		strncpy_P(msg, pMessage, sizeof(msg));
-		msg[sizeof(msg) - 1] = '\0';
-		SendSMS(number, msg);
+		strncpy_P(msg, pMessage, INFO_MESSAGE_LEN);
+		msg[INFO_MESSAGE_LEN - 1] = '\0';
+		//Informational messages can wait for a good signal
+		SendSMS(number, msg, true);
 	}
     else
         DEBUG_P(PSTR("No phonebook entry available for Informational Message"LB));
 }
 
+//Informational SMS waiting for the modem: sent when it becomes ready, the Power On one first
+void SendPendingMessages()
+{
+	if(!GSMModem.IsPBReady() || !GSMModem.IsRegisteredToNetwork())
+		return;
+
+	if(!PowerOnMessageSent)
+	{
+		SendInformationalSMS(PSTR("Thermostat Powered On"));
+		PowerOnMessageSent = true;				
+		MarkBootPhase(bpSMSReady);
+	}
+
+	if(ResetMessagePending)
+	{
+		SendInformationalSMS(PSTR("Thermostat Soft Reset"));
+		ResetMessagePending = false;
+		ResetMessageAvail--;
+	}
+
+	if(ResetCommandMessagePending)
+	{
+		SendInformationalSMS(PSTR("Thermostat User Reset"));
+		ResetCommandMessagePending = false;
+	}
+}
+
+//Modem state changes: boot profile and log. The pending messages and the error are read as modem state by loop()
+void HandleModemEvent(byte pType, int pValue)
+{
+	switch(pType)
+	{
+		case meModemReady:
+			MarkBootPhase(bpModemReady);
+			break;
+		case meRegistered:
+			MarkBootPhase(bpRegistered);
+			break;
+		case meDeregistered:
+			DEBUG_P(PSTR("** Network Lost"LB));
+			break;
+		case mePBReady:
+			MarkBootPhase(bpPBReady);
+			break;
+		case meSMSFailed:
+			DEBUG_P(PSTR("** SMS Not Sent"LB));
+			break;
+		case meModemReset:
+			DEBUG_P(PSTR("Modem Reset --> stage %d"LB), pValue);
+			break;
+	}
+}
+
+//Modem is not answering, let's try a soft reset
+void HandleModemError()
+{
+	//A modem failure before the Power On SMS is part of the boot, not a Soft Reset
+	if(PowerOnMessageSent && (ResetMessageAvail != 0))
+		ResetMessagePending = true;
+
+	DEBUG_P(PSTR("** Modem Error --> RESET"LB));
+
+	//Only the recoveries of a failing modem are counted, not the RESET command
+	if(RecoverModem())
+	{
+		Status.resetCount++;
+		Status.lastError = GSMModem.LastRecoveryStage();
+		Status.lastErrorUptime = Status.uptime;
+	}
+}
+
 void setup()
 {
+	const byte sensorPins[ZONE_COUNT] = PIN_ZONE_TEMP_SENSORS;
+	const byte setPins[ZONE_COUNT] = PIN_ZONE_RELAIS_SETS;
+	const byte resetPins[ZONE_COUNT] = PIN_ZONE_RELAIS_RESETS;
+
   //for(;;);
 
+	//A watchdog reset leaves the watchdog running
+	WATCHDOG_DISABLE();
+
     //DEBUG serial initialization
     DebugSerialInitialize();
 
@@ -128,70 +510,214 @@ void setup()
     pinMode(PIN_LED_ACTIVE, OUTPUT);
     pinMode(PIN_LED_RELAIS_SET, OUTPUT);
     
-	//Relais initialization
-    Relais.Initialize(PIN_RELAIS_SET, PIN_RELAIS_RESET);
-    //Make sure the relais is in the OFF state
-	Relais.Reset();
-    
-    //Temperature sensor initialization
-    TSense.Initialize(PIN_TEMP_SENSOR);
+	for(byte z = 0; z < ZONE_COUNT; z++)
+	{
+		//Relais initialization
+		Relais[z].Initialize(setPins[z], resetPins[z]);
+		//Make sure the relais is in the OFF state
+		Relais[z].Reset();
     
-    //Wait for corrent GSM modem initialization
-    for(;!GSMModem.Initialize(&Serial, PIN_MODEM_LED_NETWORK, PIN_MODEM_POWER););
+		TempInterval[z].Set(STABLE_TEMPERATURE_INTERVAL_MS);
+		OnCommandTS[z].Set(MAX_ON_INTERVAL_MS);
+	}
     
+    //Temperature sensor initialization
+	TSense.Initialize(sensorPins);
+	Senders.Clear();
+
 	TempDebug.Set(DEBUG_INFO_INTERVAL_MS);
-	TempInterval.Set(STABLE_TEMPERATURE_INTERVAL_MS);
-	OnCommandTS.Set(MAX_ON_INTERVAL_MS);
+	PROFILE_INITIALIZE();
+	UptimeTS.Reset();
+	TelemetryTS.Set(TELEMETRY_SAMPLE_INTERVAL_MS);
+	StateSaveTS.Set(STATE_SAVE_INTERVAL_MS);
+	//Read the network clock as soon as the modem is registered
+	ClockSyncTS.Set(0);
+	ModemRetryTS.Set(MODEM_RECOVERY_RETRY_MS);
+	ModemGivenUp = false;
 		
-	//PIN initialization
-	InitPin();
+	//PIN and thermostat state restore
+	InitState();
+
+	Schedule.Initialize(SCHED_EEPROM_START_ADDRESS);
+
+	//Control is ready before the modem: the first reading is available to loop().
+	//The blocking read does not end the relais pulses
+	WaitRelaisPulseEnd();
+	TSense.Read(LastTemp);
+	History.Initialize(Relais[SCHED_ZONE].IsSet());
+
+	for(byte z = 0; z < ZONE_COUNT; z++)
+	{
+		PIControl[z].Initialize(Relais[z].IsSet(), LastTemp[z]);
+		UpdateZoneStatus(z);
+	}
+
+	MarkBootPhase(bpControl);
+
+	GSMModem.SetIdleCallback(BackgroundTasks);
+
+    //GSM modem initialization. Power on and setup go on in loop(), a failure is handled by the staged recovery
+    GSMModem.Initialize(&MODEM_SERIAL_PORT, PIN_MODEM_LED_NETWORK, PIN_MODEM_POWER);
+
+	WATCHDOG_ENABLE();
 
     DEBUG_P(PSTR("Initialization DONE"LB));
  }
 
-boolean SendSMS(const char *pPhone, const char *pBody)
+void BackgroundTasks()
 {
-    DEBUG_P(PSTR("Queuing SMS --> %s : "), pPhone);
-    DEBUGLN(pBody);
+	for(byte z = 0; z < ZONE_COUNT; z++)
+		Relais[z].Dispatch();
+}
+
+void UpdateZoneStatus(byte pZone)
+{
+	TZoneStatus *status = &Status.zone[pZone];
+	unsigned long elapsed;
+
+	status->flags = (Active[pZone] ? ZONE_STATUS_ACTIVE : 0) | (Relais[pZone].IsSet() ? ZONE_STATUS_RELAIS : 0) | (TSense.IsFailed(pZone) ? ZONE_STATUS_FAILED : 0);
+	status->temp = (int)(LastTemp[pZone] * 10 + ((LastTemp[pZone] < 0) ? -0.5 : 0.5));
+	status->tempSet = (int)(TempSet[pZone] * 10 + 0.5);
 
-    return GSMModem.SendSMS(pPhone, pBody);
+	elapsed = OnCommandTS[pZone].Elapsed();
+	status->offMinutes = (Active[pZone] && (elapsed < MAX_ON_INTERVAL_MS)) ? (MAX_ON_INTERVAL_MS - elapsed) / 60000 : 0;
 }
 
-void ReadPinFromEEPROM()
+void UpdateSystemStatus()
 {
-	for(int i = 0; i < (sizeof(Pin) - 1); i++)
-		Pin[i] = EEPROM.read(i +  PIN_EEPROM_START_ADDRESS);
+	unsigned long elapsed = UptimeTS.Elapsed();
 
-	//Make PIN a C string
-	Pin[sizeof(Pin)-1] = '\0';
+	//Whole seconds are moved to the uptime, the rest is kept in the timestamp
+	if(elapsed >= 1000)
+	{
+		Status.uptime += elapsed / 1000;
+		UptimeTS.SetElapsed(elapsed % 1000);
+	}
+
+	Status.signalLevel = GSMModem.SignalLevel();
+	Status.smsIn = GSMModem.SMSCount(ModemGSM::qIn);
+	Status.smsOut = GSMModem.SMSCount(ModemGSM::qOut);
 }
 
-void WritePinToEEPROM()
+void FormatStatus(ReplyWriter *pReply)
 {
-	//Do not save string terminator
-	for(int i = 0; i < (sizeof(Pin) - 1); i++)
+	char tag[ZONE_TAG_LEN];
+
+	//One line per zone
+	for(byte z = 0; z < ZONE_COUNT; z++)
 	{
-		EEPROM.write(i +  PIN_EEPROM_START_ADDRESS, Pin[i]);
+		TZoneStatus *status = &Status.zone[z];
+
+		ZoneTag(tag, z);
+		pReply->Str(tag).Str_P((status->flags & ZONE_STATUS_ACTIVE) ? PSTR("ON ") : PSTR("OFF "));
+
+		if(status->flags & ZONE_STATUS_FAILED)
+			pReply->Str_P(PSTR("ERR"));
+		else
+			pReply->Tenths(status->temp);
+
+		if(status->flags & ZONE_STATUS_ACTIVE)
+		{
+			pReply->Char('/').Tenths(status->tempSet).Str_P(PSTR(" C R:")).Str_P((status->flags & ZONE_STATUS_RELAIS) ? PSTR("ON ") : PSTR("OFF "));
+			pReply->Int(status->offMinutes / 60).Char(':').Int2(status->offMinutes % 60);
+		}
+		else
+			pReply->Str_P(PSTR(" C"));
+
+		pReply->Char('\n');
 	}
+
+	//Modem and system
+	pReply->Str_P(PSTR("GSM ")).Int(Status.signalLevel).Str_P(PSTR(" SMS ")).Int(Status.smsIn).Char('/').Int(Status.smsOut);
+	pReply->Str_P(PSTR(" UP ")).Int(Status.uptime / 3600).Char('h');
+
+	if(Status.resetCount)
+		pReply->Str_P(PSTR(" RST ")).Int(Status.resetCount).Str_P(PSTR(" ERR ")).Int(Status.lastError).Char('@').Int(Status.lastErrorUptime / 3600).Char('h');
 }
 
-boolean CheckRelaisState(double pTemperature)
+byte PutLE(byte *pFrame, byte pPos, unsigned long pValue, byte pSize)
+{
+	for(byte i = 0; i < pSize; i++, pValue >>= 8)
+		pFrame[pPos++] = (byte)pValue;
+
+	return pPos;
+}
+
+void AppendTelemetry()
+{
+	byte frame[TELEMETRY_STATUS_LEN];
+	byte pos;
+	unsigned int failed = 0;
+
+	//Recent failed sends over all the signal levels (the send gate statistics are halved when full)
+	for(byte l = 0; l < 6; l++)
+		failed += GSMModem.SendAttempts(l) - GSMModem.SendSuccesses(l);
+
+	pos = PutLE(frame, 0, Status.uptime, 4);
+	frame[pos++] = Status.signalLevel;
+	frame[pos++] = Status.smsIn;
+	frame[pos++] = Status.smsOut;
+	frame[pos++] = Status.resetCount;
+	pos = PutLE(frame, pos, failed, 2);
+
+	for(byte z = 0; z < ZONE_COUNT; z++)
+	{
+		pos = PutLE(frame, pos, Status.zone[z].temp, 2);
+		pos = PutLE(frame, pos, Status.zone[z].tempSet, 2);
+		frame[pos++] = Status.zone[z].flags;
+	}
+
+	GSMModem.TelemetryAppend(TELEMETRY_FRAME_STATUS, frame, pos);
+}
+
+void WaitRelaisPulseEnd()
+{
+	for(byte z = 0; z < ZONE_COUNT; z++)
+		Relais[z].WaitPulseEnd();
+}
+
+boolean SendSMS(const char *pPhone, const char *pBody, boolean pDeferrable)
+{
+    DEBUG_P(PSTR("Queuing SMS --> %s : "), pPhone);
+    DEBUGLN(pBody);
+
+	//The zone notifications of HandleThermostatLoop() are dropped while the modem is given up
+	if(ModemGivenUp)
+	{
+		DEBUG_P(PSTR("** Modem Given Up --> SMS Dropped"LB));
+		return false;
+	}
+
+    return GSMModem.SendSMS(pPhone, pBody, pDeferrable);
+}
+
+boolean ExpectedRelaisState(byte pZone)
+{
+	if(ControlMode == CONTROL_PI)
+		return PIControl[pZone].Dispatch(LastTemp[pZone], TempSet[pZone], Relais[pZone].IsSet());
+
+	return CheckRelaisState(pZone, LastTemp[pZone]);
+}
+
+boolean CheckRelaisState(byte pZone, double pTemperature)
 {
 	//If the heater is on, power off the heater if room temperature is HALF_DELTA_TEMP above desired temperature
 	//If the heater is off, power on the heater if room temperature is HALF_DELTA_TEMP below desired temperature
-    if(Relais.IsSet())
-        return (pTemperature <= (TempSet + HALF_DELTA_TEMP));
+    if(Relais[pZone].IsSet())
+        return (pTemperature <= (TempSet[pZone] + HALF_DELTA_TEMP));
     else
-        return (pTemperature <= (TempSet - HALF_DELTA_TEMP));
+        return (pTemperature <= (TempSet[pZone] - HALF_DELTA_TEMP));
 }
 
-void HandleOff()
+void HandleOff(byte pZone)
 {
-    Active = false;
+    Active[pZone] = false;
             
-    Relais.Reset();
-    digitalWrite(PIN_LED_RELAIS_SET, LOW);
-    digitalWrite(PIN_LED_ACTIVE, LOW);
+    Relais[pZone].Reset();
+	UpdateLeds();
+	UpdateZoneStatus(pZone);
+
+	SaveState();
 }
 
 boolean CheckPin(const char * pPinToCheck)
@@ -199,75 +725,99 @@ boolean CheckPin(const char * pPinToCheck)
 	return (strlen(pPinToCheck) == 4) && (strcasecmp(Pin, pPinToCheck) == 0);
 }
 
+//Modem not answering: the zone state and the relais are left as they are, control goes on after the recovery
+boolean RecoverModem()
+{
+    //Staged modem recovery: a power cycle is used only if the modem is not answering
+	for(byte attempt = 1; !GSMModem.Recover(); attempt++)
+	{
+		if(attempt == MODEM_RECOVERY_ATTEMPTS)
+		{
+			DEBUG_P(PSTR("** Modem Not Recovered"LB));
+			//With the watchdog the board resets and powers the modem on again, a coil pulse 
+			//must not last until then. Without it control goes on and the recovery is retried by loop()
+			WaitRelaisPulseEnd();
+			WATCHDOG_REBOOT();
+			ModemGivenUp = true;
+			ModemRetryTS.Reset();
+			return false;
+		}
+	}
+
+	ModemGivenUp = false;
+	MarkBootPhase(bpModemReady);
+
+	return true;
+}
+
+//RESET command: heater power off in every zone, then the modem recovery
 void HandleReset()
 {
-	//Heater Power off
-    HandleOff();
-    
-    //wait fo GSM Modem initialization
-    for(;!GSMModem.Initialize(&Serial, PIN_MODEM_LED_NETWORK, PIN_MODEM_POWER););
+	for(byte z = 0; z < ZONE_COUNT; z++)
+		HandleOff(z);
+
+	RecoverModem();
 }
 
-void HandleCommand(TSMSPtr pItem)
+byte HandleCommand(char *pCommand, const char *pPhone, boolean *pTrusted, int *pPBIndex, ReplyWriter *pReply)
 {
-    char tmpStr[MAX_COMMAND_ANSWER_LEN];
     char temp[10];
     char temp2[10];
 	char pin[5];
     int intPart;
     int decPart;
 	double newTemp;
-	int pbIndex;
-	bool trusted;
+	int day;
+	int startHour;
+	int startMinute;
+	int endHour;
+	int endMinute;
+	int zone;
 
-#if !(MAX_COMMAND_ANSWER_LEN <= SMS_TEXT_BUFFER_SIZE)
-#error "Constant definition violates rule MAX_COMMAND_ANSWER_LEN <= SMS_TEXT_BUFFER_SIZE"	
-#endif
-    
-	//Make command uppercase, so it's easier to parse
-    strupr(pItem->body);
-    
 	//Enforce maximum command length 
-	pItem->body[MAX_COMMAND_LEN] = '\0';
+	if(strlen(pCommand) > MAX_COMMAND_LEN)
+		pCommand[MAX_COMMAND_LEN] = '\0';
 
-    DEBUG_P(PSTR("Handling Command --> "));
-    DEBUGLN(pItem->body);
+	//Every answer starts with the quoted command
+	pReply->Quoted(pCommand).Char('\n');
 
-	if(!(trusted = GSMModem.NumberExistsInPB(pItem->phone, &pbIndex)))
-	{
-		DEBUG_P(PSTR("Command Received from an untrusted number --> %s"LB), pItem->phone);
-	}
+    DEBUG_P(PSTR("Handling Command --> "));
+    DEBUGLN(pCommand);
     
     ///////////////////////////////////////////////////////////////
     //Command "REGISTER <PIN>"
     //eg REGISTER XXXX
     
-    if(sscanf_P(pItem->body, PSTR("REGISTER %4s"), pin) == 1)
+    if(sscanf_P(pCommand, PSTR("REGISTER %4s"), pin) == 1)
     {
 		if(CheckPin(pin))
 		{
 			DEBUG_P(PSTR("Handling REGISTER Command"LB));
 
-			if(trusted)
+			if(*pTrusted)
 			{
-				sprintf_P(tmpStr,PSTR("\"%s\"\nALREADY REGISTERED"),pItem->body);
+				pReply->Str_P(PSTR("ALREADY REGISTERED"));
 			}
 			else
 			{
-				sprintf_P(tmpStr,PSTR("\"%s\"\n%s"),pItem->body, (GSMModem.RegisterNumberInPB("", pItem->phone) ? "OK" : "ERROR"));
+				//The following commands of the same SMS are trusted
+				if((*pTrusted = GSMModem.RegisterNumberInPB("", pPhone)))
+					Senders.Forget(pPhone);
+				*pPBIndex = -1;
+				pReply->Str_P(*pTrusted ? PSTR("OK") : PSTR("ERROR"));
 			}
 		}
 		else
 badPin:
-			sprintf_P(tmpStr,PSTR("\"%s\"\nBad Pin"),pItem->body);
+			pReply->Str_P(PSTR("Bad Pin"));
     }
 	else 
 	{	
 		//All commands but "REGISTER" must be received from a trusted phone
-		if(!trusted)
+		if(!*pTrusted)
 		{
 			DEBUG_P(PSTR("** Command Execution Aborted"LB));
-			return;
+			return COMMAND_IGNORED;
 		}
 
 		///////////////////////////////////////////////////////////////
@@ -276,24 +826,26 @@ badPin:
 		//eg ON 1234,19
     
 		//let's hack with scanf because %f is not supported
-		byte sCount = sscanf(pItem->body, "ON %4s , %d.%d", pin, &intPart, &decPart);
+		zone = 1;
+		byte sCount = sscanf(pCommand, "ON %4s , %d.%d , %d", pin, &intPart, &decPart, &zone);
+
+		//Integer temperature followed by the zone
+		if(sCount == 2)
+			sscanf(pCommand, "ON %4s , %d , %d", pin, &intPart, &zone);
+
 		if(sCount > 1)
 		{
-			if(CheckPin(pin))
+			if(!CheckPin(pin))
+				goto badPin;
+			else if((zone < 1) || (zone > ZONE_COUNT))
+				goto badZone;
+			else
 			{
+				byte z = zone - 1;
+
 				DEBUG_P(PSTR("Handling ON Command"LB));
-				//if there are 2 field the temperature is and integer number
-				if(sCount == 2)
-					newTemp = intPart;
-				else //if there are more than 2 field the temperature is and fp number
-				{
-						newTemp = decPart;
-             
-						//divide for 10 until < 1
-						for(;newTemp >= 1; newTemp /= 10);
-            
-						newTemp += intPart;   
-				}
+				//if there are more than 2 field the temperature is and fp number
+				newTemp = MakeTemperature(intPart, decPart, sCount > 2);
         
 				dtostrf(newTemp, 1, 1 ,temp);
 				DEBUG_P(PSTR("Parse Temperature --> %s"LB), temp);
@@ -305,52 +857,62 @@ badPin:
 					newTemp = TEMP_MIN;
 
 				//if thermostat is off -> on
-				else if(!Active)
+				else if(!Active[z])
 				{        
-					Active = true;
-					digitalWrite(PIN_LED_ACTIVE, HIGH);
+					Active[z] = true;
+					UpdateLeds();
 
 					//save the phone number for future SMS send
-					strcpy(ONCommandPhone, pItem->phone);
+					strcpy(ONCommandPhone[z], pPhone);
             
 					//Stable temperature timeout initialization
-					TempInterval.Reset();
+					TempInterval[z].Reset();
 
 					//Auto heater power off timeout initialization
-					OnCommandTS.Reset();
+					OnCommandTS[z].Reset();
 
-					TempSet = newTemp;
+					TempSet[z] = newTemp;
+					PIControl[z].Reset(Relais[z].IsSet(), LastTemp[z]);
             
 					//if the heater must be powered on rember to send a SMS when the temperature will be OK
-					SendOnceTempOK = CheckRelaisState(LastTemp);
+					SendOnceTempOK[z] = CheckRelaisState(z, LastTemp[z]);
+					UpdateZoneStatus(z);
+
+					SaveState();
 
-					dtostrf(TempSet, 1, 1 , temp);
-					sprintf_P(tmpStr,PSTR("\"%s\"\nOK set to [%s C]"),pItem->body, temp);
+					pReply->Str_P(PSTR("OK set to [")).Temp(TempSet[z]).Str_P(PSTR(" C]"));
 				}
 				//Thermostat is already on send a confirmation SMS
 				else
 				{
-					dtostrf(TempSet, 1, 1 , temp);
-					dtostrf(newTemp, 1, 1 , temp2);
-					sprintf_P(tmpStr,PSTR("\"%s\"\nChanged [%s C] --> [%s C]"),pItem->body, temp, temp2);
+					pReply->Str_P(PSTR("Changed [")).Temp(TempSet[z]).Str_P(PSTR(" C] --> [")).Temp(newTemp).Str_P(PSTR(" C]"));
 				 
-					TempSet = newTemp;
+					TempSet[z] = newTemp;
+					UpdateZoneStatus(z);
+					SaveState();
 				}
 			}
-			else
-				goto badPin;
 		}
 
 		///////////////////////////////////////////////////////////////
 		//Command "UNREGISTER <PIN>"
 		//eg UNREGISTER XXXX
 
-		else if(sscanf_P(pItem->body, PSTR("UNREGISTER %4s"), pin) == 1)
+		else if(sscanf_P(pCommand, PSTR("UNREGISTER %4s"), pin) == 1)
 		{
 			if(CheckPin(pin))
 			{
 				DEBUG_P(PSTR("Handling UNREGISTER Command"LB));
-				sprintf_P(tmpStr,PSTR("\"%s\"\n%s"),pItem->body, (GSMModem.DeletePBEntryAtIndex(pbIndex) ? "OK" : "ERROR"));
+				//Registered by this same SMS: the index is not known yet
+				if((*pPBIndex < 0) && (GSMModem.LookupNumberInPB(pPhone, pPBIndex) != ModemGSM::plFound))
+					pReply->Str_P(PSTR("ERROR"));
+				else if(GSMModem.DeletePBEntryAtIndex(*pPBIndex))
+				{
+					*pTrusted = false;
+					pReply->Str_P(PSTR("OK"));
+				}
+				else
+					pReply->Str_P(PSTR("ERROR"));
 			}
 			else
 				goto badPin;
@@ -360,44 +922,49 @@ badPin:
 		//Command "OFF <PIN>"
 		//eg OFF XXXX
     
-		else if(sscanf_P(pItem->body, PSTR("OFF %4s"), pin) == 1)
+		else if(sscanf_P(pCommand, PSTR("OFF %4s , %d"), pin, &zone) >= 1)
 		{
-			if(CheckPin(pin))
+			if(!CheckPin(pin))
+				goto badPin;
+			else if((zone < 1) || (zone > ZONE_COUNT))
+			{
+badZone:
+				pReply->Str_P(PSTR("Bad Zone"));
+			}
+			else
 			{
 				DEBUG_P(PSTR("Handling OFF Command"LB));
 
-				if(Active)
+				if(Active[zone - 1])
 				{
-					sprintf_P(tmpStr,PSTR("\"%s\"\nOK"),pItem->body);
-					HandleOff();
+					pReply->Str_P(PSTR("OK"));
+					HandleOff(zone - 1);
 				}
 				else
 				{
-					sprintf_P(tmpStr,PSTR("\"%s\"\nAlready OFF"),pItem->body);
+					pReply->Str_P(PSTR("Already OFF"));
 				}
 			}
-			else
-				goto badPin;
 		}
 
 		///////////////////////////////////////////////////////////////
 		//Command "STATUS"
 		//eg STATUS
 
-		else if(strncmp_P(pItem->body, PSTR("STATUS"), 6) == 0)
+		else if(strncmp_P(pCommand, PSTR("STATUS"), 6) == 0)
 		{
 			DEBUG_P(PSTR("Handling STATUS Command"LB));
-			
-			dtostrf(TSense.ReadTemperatureInCelsius(), 1, 1 ,temp);
 
-			sprintf_P(tmpStr,PSTR("\"%s\"\n%s  %s"),pItem->body, (Active ? "ON" : "OFF"), temp);
+			//From the snapshot, the answer does not wait for the sensors or the modem
+			UpdateSystemStatus();
+			FormatStatus(pReply);
 		}
     
 		///////////////////////////////////////////////////////////////
 		//Command "MAINPHONE <PIN,<Y|N>"
 		//eg MAINPHONE XXXX, Y
     
-		else if(sscanf_P(pItem->body, PSTR("MAINPHONE  %4s,%1s"), pin, temp) == 2)
+		else if(sscanf_P(pCommand, PSTR("MAINPHONE  %4s,%1s"), pin, temp) == 2)
 		{
 			if(CheckPin(pin))
 			{
@@ -424,9 +991,9 @@ badPin:
 					res = true;
 
 				if(temp[0] == 'Y')
-					res = GSMModem.RegisterNumberInPB(MAINPHONE_PB_ENTRY, pItem->phone);
+					res = GSMModem.RegisterNumberInPB(MAINPHONE_PB_ENTRY, pPhone);
 
-				sprintf_P(tmpStr,PSTR("\"%s\"\n%s"),pItem->body, (res ? "OK" : "ERROR"));
+				pReply->Str_P(res ? PSTR("OK") : PSTR("ERROR"));
 			}
 			else
 				goto badPin;
@@ -436,29 +1003,206 @@ badPin:
 		//Command "RESET <PIN>"
 		//eg RESET XXXX
     
-		else if(sscanf_P(pItem->body, PSTR("RESET %4s"), pin) == 1)
+		else if(sscanf_P(pCommand, PSTR("RESET %4s"), pin) == 1)
 		{
 			if(CheckPin(pin))
 			{
 				DEBUG_P(PSTR("Handling RESET Command"LB));
 				ResetCommandMessagePending = true;
-				HandleReset();
-				return;
+				//The reset is done by the caller, after the answer to the previous commands. It has no answer of its own
+				return COMMAND_RESET;
 			}
 			else
 				goto badPin;
 
 		}
     
+		///////////////////////////////////////////////////////////////
+		//Command "HISTORY <PIN>"
+		//eg HISTORY XXXX
+		//Answer: one line per period, newest first: -<hours ago>h <min>/<max>/<avg> <relais duty cycle>%
+    
+		else if(sscanf_P(pCommand, PSTR("HISTORY %4s"), pin) == 1)
+		{
+			if(CheckPin(pin))
+			{
+				int minTemp;
+				int maxTemp;
+				int avgTemp;
+				byte duty;
+				boolean empty = true;
+
+				DEBUG_P(PSTR("Handling HISTORY Command"LB));
+				History.Dump();
+
+				for(byte age = 0; age < HISTORY_PERIOD_COUNT; age++)
+				{
+					if(!History.GetPeriod(age, &minTemp, &maxTemp, &avgTemp, &duty))
+						continue;
+
+					pReply->Str(empty ? "-" : "\n-").Int(age * (HISTORY_PERIOD_MS / 3600000)).Str_P(PSTR("h "));
+					pReply->Tenths(minTemp).Char('/').Tenths(maxTemp).Char('/').Tenths(avgTemp).Char(' ').Int(duty).Char('%');
+					empty = false;
+				}
+			}
+			else
+				goto badPin;
+		}
+    
+		///////////////////////////////////////////////////////////////
+		//Command "SCHED <PIN>[,<Day>[,<hh:mm>-<hh:mm>,<Temperature> | ,CLEAR]]"
+		//Day: 1 = Monday ... 7 = Sunday, 0 = every day
+		//eg SCHED XXXX,1,06:30-08:30,20.5		add an interval on monday
+		//eg SCHED XXXX,0,CLEAR					clear the whole week
+		//eg SCHED XXXX,1						list monday intervals
+		//eg SCHED XXXX							current setpoint and next change
+
+		else if((sCount = sscanf(pCommand, "SCHED %4s , %d , %d:%d - %d:%d , %d.%d", pin, &day, &startHour, &startMinute, &endHour, &endMinute, &intPart, &decPart)) >= 1)
+		{
+			if(CheckPin(pin))
+			{
+				DEBUG_P(PSTR("Handling SCHED Command"LB));
+
+				if((sCount > 1) && ((day < 0) || (day > SCHED_DAYS) || ((sCount == 2) && (day == 0) && !strstr_P(pCommand, PSTR("CLEAR")))))
+					pReply->Str_P(PSTR("Bad Day"));
+				else if(sCount >= 7)
+				{
+					newTemp = MakeTemperature(intPart, decPart, sCount > 7);
+
+					if((newTemp < TEMP_MIN) || (newTemp > TEMP_MAX) || (startHour < 0) || (endHour > 24) || 
+						(startMinute < 0) || (startMinute > 59) || (endMinute < 0) || (endMinute > 59) ||
+						((startHour * 60 + startMinute) >= (endHour * 60 + endMinute)) || ((endHour * 60 + endMinute) > MINUTES_PER_DAY))
+						pReply->Str_P(PSTR("Bad Interval"));
+					else
+					{
+						bool res = true;
+
+						for(byte d = (day ? day - 1 : 0); d < (day ? day : SCHED_DAYS); d++)
+							res &= Schedule.AddInterval(d, (startHour * 60 + startMinute) / SCHED_SLOT_MINUTES, 
+								(endHour * 60 + endMinute) / SCHED_SLOT_MINUTES, WeekSchedule::CelsiusToSetpoint(newTemp));
+
+						pReply->Str_P(res ? PSTR("OK") : PSTR("Day Full"));
+					}
+				}
+				else if((sCount == 2) && strstr_P(pCommand, PSTR("CLEAR")))
+				{
+					for(byte d = (day ? day - 1 : 0); d < (day ? day : SCHED_DAYS); d++)
+						Schedule.ClearDay(d);
+
+					pReply->Str_P(PSTR("OK"));
+				}
+				else if(sCount == 2)
+				{
+					byte startSlot;
+					byte endSlot;
+					byte setpoint;
+					boolean empty = true;
+
+					for(byte i = 0; i < SCHED_MAX_INTERVALS; i++)
+					{
+						if(!Schedule.GetInterval(day - 1, i, &startSlot, &endSlot, &setpoint))
+							continue;
+
+						pReply->Str(empty ? "" : "\n");
+						pReply->Int2(startSlot * SCHED_SLOT_MINUTES / 60).Char(':').Int2(startSlot * SCHED_SLOT_MINUTES % 60).Char('-');
+						pReply->Int2(endSlot * SCHED_SLOT_MINUTES / 60).Char(':').Int2(endSlot * SCHED_SLOT_MINUTES % 60).Char(' ');
+						pReply->Temp(WeekSchedule::SetpointToCelsius(setpoint));
+						empty = false;
+					}
+
+					if(empty)
+						pReply->Str_P(PSTR("Empty"));
+				}
+				else if(sCount == 1)
+				{
+					if(!Schedule.HasClock())
+						pReply->Str_P(PSTR("No Clock"));
+					else if(Schedule.NextTransition() == SCHED_NO_TRANSITION)
+						pReply->Str_P(PSTR("Empty"));
+					else
+					{
+						unsigned int next = Schedule.NextTransition();
+
+						pReply->Str_P(PSTR("Now "));
+
+						if(Schedule.CurrentSetpoint())
+							pReply->Temp(WeekSchedule::SetpointToCelsius(Schedule.CurrentSetpoint()));
+						else
+							pReply->Str_P(PSTR("OFF"));
+
+						strncpy_P(temp2, PSTR("MONTUEWEDTHUFRISATSUN") + (next / MINUTES_PER_DAY) * 3, 3);
+						temp2[3] = '\0';
+
+						pReply->Str_P(PSTR(" Next ")).Str(temp2).Char(' ').Int2((next % MINUTES_PER_DAY) / 60).Char(':').Int2(next % 60);
+					}
+				}
+				else
+					pReply->Str_P(PSTR("Invalid Command"));
+
+				//The current setpoint may have changed
+				if(Schedule.Dispatch())
+					ApplySchedule();
+			}
+			else
+				goto badPin;
+		}
+    
+		///////////////////////////////////////////////////////////////
+		//Command "MODE <PIN>,<H|P>"
+		//H = hysteresis (on/off), P = time proportioning PI
+		//eg MODE XXXX,P
+    
+		else if(sscanf_P(pCommand, PSTR("MODE %4s , %1s"), pin, temp) == 2)
+		{
+			if(CheckPin(pin))
+			{
+				DEBUG_P(PSTR("Handling MODE Command"LB));
+
+				if((temp[0] == 'H') || (temp[0] == 'P'))
+				{
+					ControlMode = (temp[0] == 'P') ? CONTROL_PI : CONTROL_HYSTERESIS;
+					for(byte z = 0; z < ZONE_COUNT; z++)
+					{
+						PIControl[z].Reset(Relais[z].IsSet(), LastTemp[z]);
+						TempInterval[z].Reset();
+					}
+
+					SaveState();
+
+					pReply->Str_P(PSTR("OK ")).Str_P(ControlMode == CONTROL_PI ? PSTR("PI") : PSTR("Hysteresis"));
+				}
+				else
+					pReply->Str_P(PSTR("Invalid Mode"));
+			}
+			else
+				goto badPin;
+		}
+    
+		///////////////////////////////////////////////////////////////
+		//Command "DIAG <PIN>"
+		//eg DIAG XXXX
+		//Answer: RAM <static> Free <now> Min <never used>, Heap <used> Free <free list> Max <largest free block>
+    
+		else if(sscanf_P(pCommand, PSTR("DIAG %4s"), pin) == 1)
+		{
+			if(CheckPin(pin))
+			{
+				DEBUG_P(PSTR("Handling DIAG Command"LB));
+
+				FormatMemoryInfo(pReply);
+			}
+			else
+				goto badPin;
+		}
+    
 		///////////////////////////////////////////////////////////////
 		//Command "CHPIN"
 		//eg CHPIN XXXX, YYYY
     
-		else if(sscanf(pItem->body, "CHPIN %4s , %4s", temp, temp2) == 2)
+		else if(sscanf(pCommand, "CHPIN %4s , %4s", temp, temp2) == 2)
 		{
 			if((strlen(temp) == 4) && (strlen(temp2) == 4))
 			{
-				ReadPinFromEEPROM();
 				DEBUG_P(PSTR("Old Pin --> %s"LB), temp);
 
 				if(strcasecmp(Pin, temp) == 0)
@@ -466,11 +1210,11 @@ badPin:
 					DEBUG_P(PSTR("New Pin --> %s"LB), temp2);
 
 					strcpy(Pin, temp2);
-					WritePinToEEPROM();
-					sprintf_P(tmpStr,PSTR("\"%s\"\nOK"),pItem->body);
+					SaveState();
+					pReply->Str_P(PSTR("OK"));
 				}
 				else
-					sprintf_P(tmpStr,PSTR("\"%s\"\nInvalid Pin"),pItem->body);
+					pReply->Str_P(PSTR("Invalid Pin"));
 
 			}
 			else
@@ -478,39 +1222,122 @@ badPin:
 		}
 		else
 		{
-			sprintf_P(tmpStr,PSTR("\"%s\"Invalid Command"),pItem->body);
+			pReply->Str_P(PSTR("Invalid Command"));
 		}
 	}
 
-	SendSMS(pItem->phone, tmpStr);
+	return COMMAND_DONE;
 }
 
-void HandleThermostatLoop()
+void HandleSMS(TSMSPtr pItem)
+{
+	PROFILE_SCOPE(ppHandleSMS);
+	ScratchScope scratch;
+    char *tmpStr;
+	boolean trusted = false;
+	int pbIndex = -1;
+	byte res = COMMAND_DONE;
+	char *command;
+	char *next;
+
+	//Bounded cost for a flood: over the rate the SMS is dropped, a known untrusted number skips the phonebook scan
+	switch(Senders.Check(pItem->phone))
+	{
+		case SenderFilter::svLimited:
+			DEBUG_P(PSTR("SMS Rate Limit --> %s Dropped"LB), pItem->phone);
+			return;
+		case SenderFilter::svRejected:
+			DEBUG_P(PSTR("Command Received from a known untrusted number --> %s"LB), pItem->phone);
+			break;
+		default:
+			//The sender is looked up once for all the commands. Only a number surely not in the
+			//phonebook is remembered as untrusted: after a read error the next SMS looks it up again
+			switch(GSMModem.LookupNumberInPB(pItem->phone, &pbIndex))
+			{
+				case ModemGSM::plFound:
+					trusted = true;
+					break;
+				case ModemGSM::plNotFound:
+					DEBUG_P(PSTR("Command Received from an untrusted number --> %s"LB), pItem->phone);
+					Senders.Reject(pItem->phone);
+					break;
+				default:
+					DEBUG_P(PSTR("** Sender Not Verified --> %s"LB), pItem->phone);
+			}
+	}
+
+	if(!(tmpStr = scratch.Alloc(SMS_TEXT_BUFFER_SIZE)))
+		return;
+
+	ReplyWriter reply(tmpStr, SMS_TEXT_BUFFER_SIZE);
+
+	//Make command uppercase, so it's easier to parse
+    strupr(pItem->body);
+
+	//Commands are separated by ';' or new lines, they are split in place and executed in order
+	for(command = pItem->body; command && (res != COMMAND_RESET); command = next)
+	{
+		int len = reply.Length();
+
+		if((next = strpbrk(command, ";\r\n")))
+			*next++ = '\0';
+
+		for(;*command == ' '; command++);
+
+		if(!*command)
+			continue;
+
+		//One line between the answers
+		if(len)
+			reply.Char('\n');
+
+		//Ignored commands and RESET have no answer
+		if((res = HandleCommand(command, pItem->phone, &trusted, &pbIndex, &reply)) != COMMAND_DONE)
+			reply.Truncate(len);
+	}
+
+	//One answer for all the commands
+	if(reply.Length())
+		SendSMS(pItem->phone, tmpStr, false);
+
+	if(res == COMMAND_RESET)
+		HandleReset();
+}
+
+void HandleZoneLoop(byte pZone)
 {    
-    if(Active)
+    if(Active[pZone])
     {
         boolean newRelaisState;
-        char tempStr[60];
+		ScratchScope scratch;
+        char *tempStr = scratch.Alloc(ZONE_MESSAGE_LEN);
+		char tag[ZONE_TAG_LEN];
+
+		if(!tempStr)
+			return;
+
+		ZoneTag(tag, pZone);
         
-		if(OnCommandTS.IsExpired())
+		if(OnCommandTS[pZone].IsExpired())
 		{
-			char temp[10];
+			ReplyWriter message(tempStr, ZONE_MESSAGE_LEN);
 
-			DEBUG_P(PSTR("ON COMMAND TIMEOUT EXPIRED --> OFF"LB));
+			DEBUG_P(PSTR("ON COMMAND TIMEOUT EXPIRED --> %sOFF"LB), tag);
 
-			HandleOff();
-            dtostrf(LastTemp, 1, 1 , temp);
+			HandleOff(pZone);
 
-			sprintf_P(tempStr,PSTR("Timeout Expired now OFF [%s C]"), temp);
+			message.Str(tag).Str_P(PSTR("Timeout Expired now OFF [")).Temp(LastTemp[pZone]).Str_P(PSTR(" C]"));
 
-			SendSMS(ONCommandPhone, tempStr);
+			//Scheduled ON has no source phone
+			if(ONCommandPhone[pZone][0])
+				SendSMS(ONCommandPhone[pZone], tempStr, true);
 			
 			return;
 		}
 
 
-        //Calculate the new heater expected state
-        newRelaisState = CheckRelaisState(LastTemp);
+        //Calculate the new heater expected state, no heating without a working sensor
+        newRelaisState = !TSense.IsFailed(pZone) && ExpectedRelaisState(pZone);
         
         /*if(newRelaisState != Relais.IsSet())
         {
@@ -542,139 +1369,194 @@ void HandleThermostatLoop()
         */
        
         //Se il Relais  in the wrong state
-        if(newRelaisState != Relais.IsSet())
+        if(newRelaisState != Relais[pZone].IsSet())
         {
-			dtostrf(LastTemp, 1, 1 ,tempStr);
+			dtostrf(LastTemp[pZone], 1, 1 ,tempStr);
 
-			DEBUG_P(PSTR("Relais Should change state --> %s C"LB), tempStr);
+			DEBUG_P(PSTR("%sRelais Should change state --> %s C"LB), tag, tempStr);
 
-            //temperature has stable for enauogh time ?
-			if(TempInterval.IsExpired())
+            //temperature has stable for enauogh time ? (PI control enforces its own minimum ON/OFF times)
+			if((ControlMode == CONTROL_PI) || TempInterval[pZone].IsExpired())
             {
                 //Temperature is stable change relais state
-                dtostrf(LastTemp, 1, 1 ,tempStr);                   
+                dtostrf(LastTemp[pZone], 1, 1 ,tempStr);                   
                 DEBUG_P(PSTR("State Changed and Temperature Now Stable  --> %s"LB), tempStr);
                 
                 if(newRelaisState)
                 {
-                    Relais.Set();
-                    digitalWrite(PIN_LED_RELAIS_SET, HIGH);
+                    //Rejected while the minimum OFF time is running: retried on the next loop
+                    if(Relais[pZone].Set())
+                        UpdateLeds();
                 }
                 else
                 {
-                    Relais.Reset();
-                    digitalWrite(PIN_LED_RELAIS_SET, LOW);
+                    Relais[pZone].Reset();
+                    UpdateLeds();
                     //If this is the first time that the temperaure is OK the send a SMS
-                    if(SendOnceTempOK)
+                    if(SendOnceTempOK[pZone] && (LastTemp[pZone] >= TempSet[pZone]))
                     {
-						strcpy_P(tempStr, PSTR("Temperature OK"));
-                        SendSMS(ONCommandPhone, tempStr);
-                        SendOnceTempOK = false;
+						ReplyWriter message(tempStr, ZONE_MESSAGE_LEN);
+
+						message.Str(tag).Str_P(PSTR("Temperature OK"));
+                        SendSMS(ONCommandPhone[pZone], tempStr, true);
+                        SendOnceTempOK[pZone] = false;
                     }
                 }                         
             }
         }
         else
         {
-			TempInterval.Reset();
+			TempInterval[pZone].Reset();
         }        
     };
+}
+
+//Bench runs of the simulated sensor: control mode and target as a MODE and ON command would set them, nothing is saved
+void ApplyScenario(byte pZone)
+{
+	char mode;
+	float target;
+
+	if(!TSense.Scenario(pZone, &mode, &target))
+		return;
+
+	ControlMode = (mode == 'P') ? CONTROL_PI : CONTROL_HYSTERESIS;
+	TempSet[pZone] = target;
+
+	if(!Active[pZone])
+	{
+		Active[pZone] = true;
+		UpdateLeds();
+	}
+
+	//Every run starts the control from scratch
+	TempInterval[pZone].Reset();
+	SendOnceTempOK[pZone] = false;
+	PIControl[pZone].Reset(Relais[pZone].IsSet(), LastTemp[pZone]);
+	OnCommandTS[pZone].Reset();
+}
+
+void HandleThermostatLoop()
+{    
+	PROFILE_SCOPE(ppThermostatLoop);
+
+	//Follow the weekly schedule, a manual command holds until the next scheduled change
+	if(Schedule.Dispatch())
+		ApplySchedule();
+
+	//Save the ON period progress, so a reset does not restart it
+	if(StateSaveTS.IsExpired())
+		SaveState();
+
+	for(byte z = 0; z < ZONE_COUNT; z++)
+	{
+		HandleZoneLoop(z);
+		UpdateZoneStatus(z);
+		TSense.Feedback(z, Relais[z].IsSet(), Active[z] ? TempSet[z] : 0);
+		ApplyScenario(z);
+	}
 
 	if(TempDebug.IsExpired())
     {
-        char tempStr[10];
+		ScratchScope scratch;
+        char *tempStr = scratch.Alloc(DEBUG_INFO_LEN);
             
 		TempDebug.Reset();
 
-        dtostrf(LastTemp, 1, 1 ,tempStr);
-        DEBUG_P(PSTR("Temperature --> %s C"LB), tempStr);
-        
- 		if(Active)
+		if(!tempStr)
+			return;
+
+		ReplyWriter info(tempStr, DEBUG_INFO_LEN);
+
+		FormatMemoryInfo(&info);
+		DEBUGLN(tempStr);
+		PROFILE_REPORT();
+
+		for(byte z = 0; z < ZONE_COUNT; z++)
 		{
-			dtostrf(TempSet, 1, 1 ,tempStr);
-			DEBUG_P(PSTR("User Temperature --> %s C"LB), tempStr);
+			dtostrf(LastTemp[z], 1, 1 ,tempStr);
+			DEBUG_P(PSTR("Zone %d Temperature --> %s C"LB), (int)z + 1, tempStr);
+        
+ 			if(Active[z])
+			{
+				dtostrf(TempSet[z], 1, 1 ,tempStr);
+				DEBUG_P(PSTR("User Temperature --> %s C"LB), tempStr);
 				
-			DEBUG_P(PSTR("Relais --> "));		
+				DEBUG_P(PSTR("Relais --> "));		
 
-			if(Relais.IsSet())
-			{
-				DEBUG_P(PSTR("SET"LB));
-			}
-			else
-			{
-				DEBUG_P(PSTR("RESET"LB));
+				if(Relais[z].IsSet())
+				{
+					DEBUG_P(PSTR("SET"LB));
+				}
+				else
+				{
+					DEBUG_P(PSTR("RESET"LB));
+				}
 			}
+
+			DEBUG_P(PSTR("Relais Cycles --> %lu On Time --> %lu s"LB), Relais[z].SwitchCount(), Relais[z].OnTime());
 		}
     }
 }
 
 void loop()
 {
-	//Read current temperature
-    LastTemp = TSense.ReadTemperatureInCelsius();            
+	WATCHDOG_RESET();
 
-	//Allow the modem to process events
-    GSMModem.Dispatch();
+	BackgroundTasks();
 
-	//Modem is not answering, let's try a soft reset
-	if(GSMModem.Error())
+	//Read current temperature of all the zones, LastTemp is updated when the conversions are done
 	{
-		if(ResetMessageAvail != 0)
-			ResetMessagePending = true;
-
-		DEBUG_P(PSTR("** Modem Error --> RESET"LB));
-		HandleReset();
-		return;
+		PROFILE_SCOPE(ppSensor);
+		TSense.Dispatch(LastTemp);
 	}
+	History.Dispatch(LastTemp[SCHED_ZONE], Relais[SCHED_ZONE].IsSet());
 
-	//Is Power On SMS has not been sent
-	if(!PowerOnMessageSent)
+	//Allow the modem to process events. A modem given up is left alone until the next recovery attempt
+	if(!ModemGivenUp)
 	{
-		//Modem ready ?
-		if(GSMModem.IsPBReady() && GSMModem.IsRegisteredToNetwork())
-		{
-			//Send SMS to MAINPHONE command telephone number
-			SendInformationalSMS(PSTR("Thermostat Powered On"));
-			PowerOnMessageSent = true;				
-		}
+		PROFILE_SCOPE(ppModemDispatch);
+		GSMModem.Dispatch();
 	}
+	UpdateSystemStatus();
 
-	if(ResetMessagePending || ResetCommandMessagePending || !PowerOnMessageSent)
+	//Sampled from the status snapshot, the modem sends the frames in batches
+	if(ModemGSM::TelemetrySize && TelemetryTS.IsExpired())
 	{
-		//Modem ready to send SMS ?
-		if(GSMModem.IsPBReady() && GSMModem.IsRegisteredToNetwork())
-		{
-			if(ResetMessagePending)
-			{
-				//Send SMS to MAINPHONE command telephone number
-				SendInformationalSMS(PSTR("Thermostat Soft Reset"));
-				ResetMessagePending = false;
-				ResetMessageAvail--;
-			}
+		TelemetryTS.Reset();
+		AppendTelemetry();
+	}
 
-			if(ResetCommandMessagePending)
-			{
-				//Send SMS to MAINPHONE command telephone number
-				SendInformationalSMS(PSTR("Thermostat User Reset"));
-				ResetCommandMessagePending = false;
-			}
+	for(TModemEvent event; GSMModem.GetEvent(&event);)
+		HandleModemEvent(event.type, event.value);
 
-			if(!PowerOnMessageSent)
-			{
-				//Send SMS to MAINPHONE command telephone number
-				SendInformationalSMS(PSTR("Thermostat Powered On"));
-				PowerOnMessageSent = true;				
-			}
-		}
+	//Read as state, a full event queue cannot lose them. A modem given up by RecoverModem() is tried again from time to time
+	if(GSMModem.Error() && (!ModemGivenUp || ModemRetryTS.IsExpired()))
+	{
+		HandleModemError();
+		return;
 	}
 
+	//No modem traffic (messages, clock, phonebook) while the modem is given up: the zones are still controlled
+	if(ModemGivenUp)
+	{
+		HandleThermostatLoop();
+		return;
+	}
+
+	SendPendingMessages();
+
+	if(ClockSyncTS.IsExpired() && GSMModem.IsRegisteredToNetwork())
+		SyncClock();
+
 	//Is a SMS is available
 	if(GSMModem.IsSMSAvailable())
     {
-        TSMS item;
+		ScratchScope scratch;
+        TSMSPtr item = (TSMSPtr)scratch.Alloc(sizeof(TSMS));
         
-        if(GSMModem.SMSDequeue(ModemGSM::qIn, &item))
-            HandleCommand(&item);
+        if(item && GSMModem.SMSDequeue(ModemGSM::qIn, item))
+            HandleSMS(item);
     }
     else
         HandleThermostatLoop();
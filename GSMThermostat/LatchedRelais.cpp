@@ -11,28 +11,89 @@ void LatchedRelais::Initialize(byte pSetPin, byte pResetPin)
     pinMode(pResetPin, OUTPUT);    
     FPackedVars.pinSet = pSetPin;
     FPackedVars.pinReset = pResetPin;
+
+    FPulsing = false;
+    FResetPending = false;
+    FSwitchCount = 0;
+    FOnTimeS = 0;
+    FLastTransitionTS = millis();
 }
 
-void LatchedRelais::Set()
+void LatchedRelais::StartPulse(boolean pStatus)
 {
+    //Cycle accounting on real transitions only
+    if(pStatus != FStatus)
+    {
+        unsigned long now = millis();
+
+        if(FStatus)
+            FOnTimeS += SafeSub(now, FLastTransitionTS) / 1000;
+
+        FSwitchCount++;
+        FLastTransitionTS = now;
+    }
+
 #if LATCHED_RELAIS
-    PulseOut(FPackedVars.pinSet, RELAIS_PULSE_DURATION_MS);
+    digitalWrite(pStatus ? FPackedVars.pinSet : FPackedVars.pinReset, HIGH);
+    FPulsing = true;
+    FPulseTS = millis();
 #else
-	digitalWrite(FPackedVars.pinSet, HIGH);
+	digitalWrite(FPackedVars.pinSet, pStatus ? HIGH : LOW);
 #endif
-    FStatus = true;
+    FStatus = pStatus;
+}
+
+boolean LatchedRelais::Set()
+{
+    if(FPulsing)
+    {
+        DEBUG_P(PSTR("** Relais SET Rejected --> Busy"LB));
+        return false;
+    }
+
+    if(!FStatus && FSwitchCount && (TimeInState() < RELAIS_MIN_SWITCH_MS))
+    {
+        DEBUG_P(PSTR("** Relais SET Rejected --> Min Cycle Time"LB));
+        return false;
+    }
+
+    StartPulse(true);
     DEBUG_P(PSTR("Relais --> SET"LB));
+    return true;
 }
 
-void LatchedRelais::Reset()
+boolean LatchedRelais::Reset()
 {
-#if LATCHED_RELAIS
-    PulseOut(FPackedVars.pinReset, RELAIS_PULSE_DURATION_MS);
-#else
-	digitalWrite(FPackedVars.pinSet, LOW);
-#endif
-	FStatus = false;
+    //Switching off is never lost
+    if(FPulsing)
+        FResetPending = true;
+    else
+        StartPulse(false);
+
     DEBUG_P(PSTR("Relais --> RESET"LB));
+    return true;
+}
+
+void LatchedRelais::Dispatch()
+{
+    if(FPulsing && (SafeSub(millis(), FPulseTS) >= RELAIS_PULSE_DURATION_MS))
+    {
+        digitalWrite(FPackedVars.pinSet, LOW);
+        digitalWrite(FPackedVars.pinReset, LOW);
+        FPulsing = false;
+
+        if(FResetPending)
+        {
+            FResetPending = false;
+            StartPulse(false);
+        }
+    }
+}
+
+void LatchedRelais::WaitPulseEnd()
+{
+    for(;FPulsing;)
+        Dispatch();
 }
 
 boolean LatchedRelais::IsSet()
@@ -40,3 +101,12 @@ boolean LatchedRelais::IsSet()
     return FStatus;
 }
 
+unsigned long LatchedRelais::OnTime()
+{
+    return FOnTimeS + (FStatus ? TimeInState() / 1000 : 0);
+}
+
+unsigned long LatchedRelais::TimeInState()
+{
+    return SafeSub(millis(), FLastTransitionTS);
+}
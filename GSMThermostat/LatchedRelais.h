@@ -3,27 +3,49 @@
 #include "WProgram.h"
 
 #define RELAIS_PULSE_DURATION_MS            300
+#define RELAIS_MIN_SWITCH_MS                ((unsigned long)1000*60)	//Minimum OFF time before the next SET
 
+////////////////////////////////////////////////////////////////////////////////////
+//	Set() and Reset() start the coil pulse and return, Dispatch() ends it when
+//	RELAIS_PULSE_DURATION_MS is over. A Set() while a pulse is in progress or
+//	before RELAIS_MIN_SWITCH_MS in the OFF state is rejected. A Reset() is never
+//	rejected: while a pulse is in progress it is started right after it.
+////////////////////////////////////////////////////////////////////////////////////
 class LatchedRelais
 {
 public:
     void Initialize(byte pSetPin, byte pResetPin);
 
-    void Set();
-    void Reset();
+    boolean Set();
+    boolean Reset();
+    void Dispatch();
+    void WaitPulseEnd();
 
     boolean IsSet();
+    inline boolean IsBusy() { return FPulsing; };
+
+    inline unsigned long SwitchCount() { return FSwitchCount; };
+    unsigned long OnTime();
+    unsigned long TimeInState();
 private:
+    //Whole bytes: with multiple zones on a Mega pin numbers do not fit in 4 bits
     typedef struct _PackedVars
     {
-        byte pinSet : 4;  
-        byte pinReset : 4; 
+        byte pinSet;  
+        byte pinReset; 
     } 
     PackedVars;    
 private:
     boolean FStatus; 
     PackedVars FPackedVars;
+    boolean FPulsing;
+    boolean FResetPending;
+    unsigned long FPulseTS;
+    unsigned long FSwitchCount;                 //Number of state changes
+    unsigned long FOnTimeS;                     //Cumulative ON time (s), current ON period excluded
+    unsigned long FLastTransitionTS;
+
+    void StartPulse(boolean pStatus);
 };
 
 #endif
-
@@ -0,0 +1,58 @@
+#include "LatencyEstimator.h"
+
+#define MAX_RTTVAR_MS	16000
+
+void LatencyEstimator::Clear()
+{
+	FSRTT = 0;
+	FRTTVar = 0;
+}
+
+void LatencyEstimator::Update(unsigned int pSampleMS)
+{
+	//0 means "no samples"
+	if(pSampleMS == 0)
+		pSampleMS = 1;
+
+	if(FSRTT == 0)
+	{
+		//First sample
+		FSRTT = pSampleMS;
+		FRTTVar = pSampleMS / 2;
+	}
+	else
+	{
+		unsigned int delta = (FSRTT > pSampleMS) ? (FSRTT - pSampleMS) : (pSampleMS - FSRTT);
+
+		//RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+		FRTTVar = (unsigned int)(((unsigned long)FRTTVar * 3 + delta) / 4);
+		FSRTT = (unsigned int)(((unsigned long)FSRTT * 7 + pSampleMS) / 8);
+
+		if(FSRTT == 0)
+			FSRTT = 1;
+	}
+}
+
+void LatencyEstimator::Backoff()
+{
+	//A timeout widens the deviation, the next timeout will be longer
+	if(FSRTT != 0)
+		FRTTVar = (FRTTVar >= (MAX_RTTVAR_MS / 2)) ? MAX_RTTVAR_MS : (FRTTVar ? FRTTVar * 2 : FSRTT);
+}
+
+unsigned int LatencyEstimator::GetTimeout(unsigned int pInitialMS, unsigned int pFloorMS, unsigned int pCeilingMS)
+{
+	unsigned long res;
+
+	if(FSRTT == 0)
+		return pInitialMS;
+
+	res = (unsigned long)FSRTT + (unsigned long)FRTTVar * 4;
+
+	if(res < pFloorMS)
+		return pFloorMS;
+	if(res > pCeilingMS)
+		return pCeilingMS;
+
+	return (unsigned int)res;
+}
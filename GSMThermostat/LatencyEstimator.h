@@ -0,0 +1,27 @@
+#ifndef __LATENCY_ESTIMATOR
+#define __LATENCY_ESTIMATOR
+
+#include "WProgram.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Smoothed latency and deviation of a request/answer exchange, TCP RTO style
+//	(RFC 6298): timeout = SRTT + 4 * RTTVAR, clamped by the caller limits
+////////////////////////////////////////////////////////////////////////////////////
+class LatencyEstimator
+{
+public:
+	void Clear();
+	void Update(unsigned int pSampleMS);
+	void Backoff();
+	unsigned int GetTimeout(unsigned int pInitialMS, unsigned int pFloorMS, unsigned int pCeilingMS);
+
+	inline boolean HasSamples() { return FSRTT != 0; };
+	inline unsigned int SRTT() { return FSRTT; };
+	inline unsigned int RTTVar() { return FRTTVar; };
+protected:
+	//Saved as is in EEPROM by ModemGSM: the size must not depend on the int size of the build
+	uint16_t FSRTT;
+	uint16_t FRTTVar;
+};
+
+#endif
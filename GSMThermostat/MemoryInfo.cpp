@@ -0,0 +1,62 @@
+#include "MemoryInfo.h"
+
+//avr-libc linker symbols and malloc internals
+extern char __data_start;
+extern char _end;
+extern char __heap_start;
+extern char *__brkval;
+
+struct __freelist
+{
+	size_t sz;
+	struct __freelist *nx;
+};
+
+extern struct __freelist *__flp;
+
+void StackPaint(void) __attribute__ ((naked)) __attribute__ ((section (".init1"))) __attribute__ ((used));
+
+//Runs before __zero_reg__ is cleared: assembly only
+void StackPaint(void)
+{
+	__asm volatile ("    ldi r30,lo8(_end)\n"
+					"    ldi r31,hi8(_end)\n"
+					"    ldi r24,lo8(0xc5)\n"		//STACK_CANARY
+					"    ldi r25,hi8(__stack)\n"
+					"    rjmp .cmp\n"
+					".loop:\n"
+					"    st Z+,r24\n"
+					".cmp:\n"
+					"    cpi r30,lo8(__stack)\n"
+					"    cpc r31,r25\n"
+					"    brlo .loop\n"
+					"    breq .loop"::);
+}
+
+void GetMemoryInfo(TMemoryInfo *pInfo)
+{
+	char *heapTop = (__brkval ? __brkval : &__heap_start);
+	char *p;
+	char top;
+	struct __freelist *fp;
+
+	pInfo->staticRam = &_end - &__data_start;
+	pInfo->freeRam = &top - heapTop;
+	pInfo->heapUsed = heapTop - &__heap_start;
+
+	//The deepest stack frame left the first byte not painted any more
+	for(p = heapTop; (p < &top) && (*p == (char)STACK_CANARY); p++);
+	pInfo->stackUnused = p - heapTop;
+
+	pInfo->heapFree = 0;
+	pInfo->heapLargest = 0;
+
+	//Blocks freed below the heap top: the larger the difference the more fragmented the heap
+	for(fp = __flp; fp; fp = fp->nx)
+	{
+		pInfo->heapFree += fp->sz;
+
+		if(fp->sz > pInfo->heapLargest)
+			pInfo->heapLargest = fp->sz;
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef __MEMORY_INFO
+#define __MEMORY_INFO
+#include "WProgram.h"
+
+#define STACK_CANARY				0xC5		//Paint value of the free RAM at boot
+
+////////////////////////////////////////////////////////////////////////////////////
+//	RAM layout (ATmega328): .data .bss | heap -->     <-- stack | RAMEND
+//	The free RAM between .bss and the stack is painted with STACK_CANARY before
+//	the C runtime starts (.init1). Painted bytes still found above the heap are 
+//	RAM that neither the heap nor the stack ever used: the high water mark.
+////////////////////////////////////////////////////////////////////////////////////
+
+typedef struct _MemoryInfo
+{
+	unsigned int staticRam;					//.data + .bss
+	unsigned int freeRam;					//Between the heap top and the stack pointer, now
+	unsigned int stackUnused;				//Never touched since boot
+	unsigned int heapUsed;					//Heap top - heap start
+	unsigned int heapFree;					//Free list total
+	unsigned int heapLargest;				//Free list largest block
+}TMemoryInfo;
+
+extern void GetMemoryInfo(TMemoryInfo *pInfo);
+
+#endif
@@ -5,36 +5,81 @@
 #include "Utils.h"
 #include "ModemGSM.h"
 #include <pins_arduino.h>
+#include <EEPROM.h>
 
 #define CR 13
 #define LF 10
 #define TIMEOUT 0
-#define KEEPALIVE_INTERVAL_MS 15000
 
 #define INIT_SEQUENCE "ATE0 ; +CREG=1; +CMGF=1; +CSCS=\"IRA\"; +CNMI=1,1; +CMER=2,0,0,1,1; +CMEE=2"
 
 // ATE1 ; +CREG=1; +CMGF=1; +CSCS="IRA"; +CNMI=1,1; +CMER=2,0,0,1,1
 
+//Initial, minimum and maximum answer timeout for every command class, counted from the command.
+//AT+CMGW and AT+CMSS are not idempotent (a retry after a false timeout stores or sends the SMS twice):
+//their minimum is the old fixed timeout, the learned value can only make them longer
+PROGMEM prog_uint16_t CommandTimeouts[][3] = 
+{
+	{1000,	300,	2000},		//ccKeepAlive		AT
+	{5000,	1000,	10000},		//ccPhonebook		AT+CPBR, AT+CPBF, AT+CPBW
+	{5000,	1000,	10000},		//ccSMSRead			AT+CMGR, AT+CMGD
+	{20000,	20000,	30000},		//ccSMSStore		AT+CMGW, AT+CMGD=0,4
+	{45000,	45000,	60000},		//ccSMSSend			AT+CMSS
+	{2000,	500,	5000}		//ccClock			AT+CCLK?
+};
+
+
+//Sakamoto's day of week, month offsets
+PROGMEM prog_uchar MonthOffset[] = {0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4};
 
 byte resetCount=0;
 
-void ModemGSM::DiscardSerialInput(unsigned int pTimeout)
+//SendCommand() output stream, udata is the modem serial
+template <class TSerial>
+static int CommandPutChar(char c, FILE *pStream)
+{
+	((TSerial *)fdev_get_udata(pStream))->print(c);
+	return 0;
+}
+
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::DiscardSerialInput(unsigned int pTimeout)
 {
 	unsigned long ts = millis();
 
 	for(;SafeSub(millis(), ts) < pTimeout;)
 	{
+		if(FIdleCallback)
+			FIdleCallback();
+
 		if(FSerial->available() > 0)
 			FSerial->read();
 	}    
 }
 
-void ModemGSM::DiscardPrompt(unsigned int pTimeout)
+//delay() that keeps the sketch background tasks running (the relais pulses end on time)
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::IdleDelay(unsigned int pTimeout)
+{
+	unsigned long ts = millis();
+
+	for(;SafeSub(millis(), ts) < pTimeout;)
+	{
+		if(FIdleCallback)
+			FIdleCallback();
+	}    
+}
+
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::DiscardPrompt(unsigned int pTimeout)
 {
 	unsigned long ts = millis();
 
 	for(;SafeSub(millis(), ts) < pTimeout;)
 	{
+		if(FIdleCallback)
+			FIdleCallback();
+
 		if(FSerial->available() > 0)
 		{
 			if(FSerial->read() == '>')
@@ -43,109 +88,38 @@ void ModemGSM::DiscardPrompt(unsigned int pTimeout)
 	}    
 }
 
-int ModemGSM::Dispatch()
+template <class TSerial, class TConfig>
+int ModemGSMBase<TSerial, TConfig>::Dispatch()
 {
 	int res = 0;
 	int level;
 	int ind;
-	static int state=0;
 
 	EvalNetworkLedStatus();
 
-#ifdef REGISTRATION_DELAYED
-	if(FNetworkRegDelayActive && FNetworkRegDelayTS.IsExpired())
+	//Nothing else until the modem is set up
+	if(FStartupStage != ssReady)
+	{
+		Startup();
+		return res;
+	}
+
+	if(TConfig::RegistrationDelayMS && FNetworkRegDelayActive && FNetworkRegDelayTS.IsExpired())
 	{
 		DEBUG_P(PSTR("Network Registration Delay Expired --> Now Registered To Network"LB));                    
 
 		FNetworkRegDelayActive = false;
-		FRegisteredToNetwork = true;
+		SetRegistered(true);
 	}
-#endif
-	if(FLastKeepAliveTS.IsExpired())
-	{
-#if SIMULATION
-		if(FPBReady)
-		{
-			int idx;
-			char temp[30];
-
-//			switch(state % 3) //repeat commands
-			switch(state)
-			{
-				case 0:
-				{
-					DEBUG_P(PSTR("---- Posting Fake SMS"LB));
-					WriteSMS("+390000000000", "ON 0000,22", &idx);
-					sprintf_P(temp, PSTR("+CMTI: \"SM\",%d"), idx);
-					break;
-				}
-				case 1:
-				{
-					DEBUG_P(PSTR("---- Posting Fake SMS"LB));
-					WriteSMS("+390000000000", "ON 0000,22", &idx);
-					sprintf_P(temp, PSTR("+CMTI: \"SM\",%d"), idx);
-					break;
-				}
-
-				default:
-				{
-					temp[0] = 0;
 
-					if(!SendKeepAlive())
-					{
-						FKeepAliveFailedCount++;
-						//if the modem is not answering try the hard way ...
-						if(FKeepAliveFailedCount > 5)
-						{
-							//Try to power off the modem
-							SendCommand("AT+CPWROFF");
-							delay(1000);
-
-							//Signal Error condition
-							FError = true;
-							return res;
-						}
-					}
-					else
-					{
-						FError = false;
-						FKeepAliveFailedCount = 0;
-					}				
-				}
-			}
-
-			state++;
-			if(temp[0])
-			{
-				FURCQueue.Enqueue(temp);			
-				DEBUG_P(PSTR("---- Posted Fake SMS"LB));
-			}
-		}
-		else
-#endif
-			if(!SendKeepAlive())
-			{
-				FKeepAliveFailedCount++;
-				//if the modem is not answering try the hard way ...
-				if(FKeepAliveFailedCount > 5)
-				{
-					//Try to power off the modem
-					SendCommand("AT+CPWROFF");
-					delay(1000);
-
-					//Signal Error condition
-					FError = true;
-					return res;
-				}
-			}
-			else
-			{
-				FError = false;
-				FKeepAliveFailedCount = 0;
-			}
+	if(FLastKeepAliveTS.IsExpired() && !KeepAlive())
+		return res;
 
-		FLastKeepAliveTS.Reset();
-	};
+	if(FLatencySaveTS.IsExpired())
+	{
+		FLatencySaveTS.Reset();
+		SaveLatencyTable();
+	}
 	
 	int idx;
 	//Check for Queued URC or Data from Modem SerialLine
@@ -166,6 +140,8 @@ int ModemGSM::Dispatch()
 		{
 			if(ind == 2)
 			{
+				byte prev = FSignalLevel;
+
 				if((level >= 1) && (level <= 5))
 				{
 					FSignalLevel = level;
@@ -176,29 +152,37 @@ int ModemGSM::Dispatch()
 					FSignalLevel = UNKNOWN_LEVEL;
 					DEBUG_P(PSTR("**BAD Signal Strength --> %d"LB), level);                    
 				}
+
+				//The trend is judged against the level before the last change
+				if(FSignalLevel != prev)
+				{
+					FPrevSignalLevel = prev;
+					FSignalChangeTS.Reset();
+				}
 			}
 		}
 		else if(sscanf_P(FRXBuff,PSTR("+CREG: %d"), &level) == 1)
 		{
 			if((level == 1) || (level == 5))
 			{
-#ifdef REGISTRATION_DELAYED
-				DEBUG_P(PSTR("Registered to Network Indication --> Starting Delay"LB));                    
-				FNetworkRegDelayActive = true;
-				//Wait for a while to be sure that SMS will work
-				FNetworkRegDelayTS.Reset(); 
-#else
-				FRegisteredToNetwork = true;
-				DEBUGLN_P(PSTR("Registered to Network"LB)); 
-#endif
+				if(TConfig::RegistrationDelayMS)
+				{
+					DEBUG_P(PSTR("Registered to Network Indication --> Starting Delay"LB));                    
+					FNetworkRegDelayActive = true;
+					//Wait for a while to be sure that SMS will work
+					FNetworkRegDelayTS.Reset(); 
+				}
+				else
+				{
+					SetRegistered(true);
+					DEBUG_P(PSTR("Registered to Network"LB)); 
+				}
 			}
 			else
 			{
 				DEBUG_P(PSTR("NOT Registered to Network"LB));
-				FRegisteredToNetwork = false;
-#ifdef REGISTRATION_DELAYED
+				SetRegistered(false);
 				FNetworkRegDelayActive = false;
-#endif
 			}
 			FLastBlinkTS.Reset();
 			EvalNetworkLedStatus();
@@ -207,22 +191,35 @@ int ModemGSM::Dispatch()
 		{        
 			resetCount++;
 			DEBUG_P(PSTR("Module RESET"LB));
+			AdaptKeepAlive(false);
 			DiscardSerialInput(5000);
 			InnerSetup();
+			PostEvent(meModemReset, rsNone);
 		}
 		else if(strcmp_P(FRXBuff,PSTR("+PBREADY")) == 0)
 		{        
 			FPBReady = true;
+			//The phonebook may have changed while the modem was off: indexed again by the next Dispatch calls
+			ResetPBIndex();
+
+			//The stored SMS are deleted below: queued indexes are not valid anymore
+			FSMSInQueue.Clear();
+			FSMSOutQueue.Clear();
+			FSMSResendPending = false;
+			FSMSDeferActive = false;
+			FReadSMSCount = 0;
+
 			for(int i = 0; i < 10; i++)
 				if(ClearSMSMemory())
 					break;
 				else
 				{
-					delay(1000);
+					WaitReady(1000);
 					DEBUG_P(PSTR("Retrying .... "LB));
 				}
 				
 			FLastKeepAliveTS.Reset();
+			PostEvent(mePBReady);
 		}
 		else
 		{
@@ -231,17 +228,43 @@ int ModemGSM::Dispatch()
 		}    
 	}
 
+	//One page of the phonebook per call, the loop is not stalled by a large SIM
+	if(FPBReady && !FPBIndexReady)
+		IndexPBPage();
+
+	//Telemetry is sent once per interval, with everything stored meanwhile
+	if(TelemetrySize && FTelemetryLen && FRegisteredToNetwork && FTelemetryTS.IsExpired())
+	{
+		FTelemetryTS.Reset();
+		TelemetryFlush();
+	}
+
+	//Incoming SMS are deleted together at the end of a burst: one command instead of one per SMS
+	if(FReadSMSCount && (!FSMSInQueue.Count() || (FReadSMSCount >= SMS_BULK_DELETE_COUNT)))
+		DeleteReadSMS();
+
 	//Do not fire SMS retries if the network is not available
 	if((FSMSOutQueue.Count() && FRegisteredToNetwork) && !(FSMSResendPending && !FSMSResendTS.IsExpired()))    
 	{
 		int idx;
+		boolean sent;
 
 		FSMSOutQueue.Peek(&idx);
+
+		//Deferrable SMS wait for a good signal
+		if((idx & SMS_DEFERRABLE_FLAG) && !SendGateOpen())
+			return res;
+
+		sent = SendSMSAtIndex(idx & ~SMS_DEFERRABLE_FLAG);
+		RecordSendResult(sent);
 		
-		if(SendSMSAtIndex(idx))
+		if(sent)
 		{
 			SMSDequeue(qOut, NULL);
 			FSMSResendPending = false;
+
+			if(idx & SMS_DEFERRABLE_FLAG)
+				UpdateDeferState();
 		}
 		else
 		{
@@ -260,6 +283,10 @@ int ModemGSM::Dispatch()
 					//discard SMS
 					FSMSResendPending = false;
 					FSMSOutQueue.Dequeue(NULL);
+
+					if(idx & SMS_DEFERRABLE_FLAG)
+						UpdateDeferState();
+					PostEvent(meSMSFailed);
 					DEBUG_P(PSTR("** Too Many Retries SMS Send Aborted"LB));
 				}
 			}
@@ -277,7 +304,8 @@ int ModemGSM::Dispatch()
 	return res;
 }
 
-void ModemGSM::EvalNetworkLedStatus()
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::EvalNetworkLedStatus()
 {
 	if(FRegisteredToNetwork)
 	{
@@ -294,9 +322,9 @@ void ModemGSM::EvalNetworkLedStatus()
 				for(int i = 0; i < FSignalLevel; i++)
 				{
 					digitalWrite(FNetworkLedPin, HIGH);	
-					delay(150);
+					IdleDelay(150);
 					digitalWrite(FNetworkLedPin, LOW);	
-					delay(100);
+					IdleDelay(100);
 				}
 			}		
 		}
@@ -308,55 +336,210 @@ void ModemGSM::EvalNetworkLedStatus()
 }
 
 
-boolean ModemGSM::Initialize(HardwareSerial *pSerial, byte pNetworkLedPin, byte pPowerOnPin)
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::Initialize(TSerial *pSerial, byte pNetworkLedPin, byte pPowerOnPin)
 {
 	pinMode(pNetworkLedPin, OUTPUT);
 	pinMode(pPowerOnPin, OUTPUT);
 
 	FSerial = pSerial;
+	fdev_setup_stream(&FCommandStream, CommandPutChar<TSerial>, NULL, _FDEV_SETUP_WRITE);
+	fdev_set_udata(&FCommandStream, pSerial);
 	FNetworkLedPin = pNetworkLedPin;
 	FPowerOnPin = pPowerOnPin;
 
-	FLastKeepAliveTS.Set(KEEPALIVE_INTERVAL_MS);
+	FKeepAliveIntervalMS = KEEPALIVE_INTERVAL_MS;
+	FLastKeepAliveTS.Set(FKeepAliveIntervalMS);
 	FLastBlinkTS.Set(NETWORK_LED_UPDATE_INTERVAL_MS);
-#ifdef REGISTRATION_DELAYED
-	FNetworkRegDelayTS.Set(NETWORK_REGISTRAION_DELAY_MS);
-#endif
+	FNetworkRegDelayTS.Set(TConfig::RegistrationDelayMS);
 	FSMSResendTS.Set(SMS_RETRY_DELAY_MS);
+	FSMSDeferTS.Set(SMS_MAX_DEFER_MS);
+	FSignalChangeTS.Set(SMS_SIGNAL_TREND_MS);
+	FSendMinLevel = SMS_SEND_MIN_LEVEL;
+	memset(FSendAttempts, 0, sizeof(FSendAttempts));
+	memset(FSendOK, 0, sizeof(FSendOK));
+
+	FLastRecoveryStage = rsNone;
+	memset(FRecoveryStageMS, 0, sizeof(FRecoveryStageMS));
+
+	FLatencySaveTS.Set(LATENCY_SAVE_INTERVAL_MS);
+	LoadLatencyTable();
+
+	//Kept across recoveries: frames wait for the network
+	FTelemetryLen = 0;
+	FTelemetrySeq = 0;
+	FTelemetryLost = 0;
+	FTelemetryTS.Set((unsigned long)TConfig::TelemetryIntervalS * 1000);
+
+	ResetState(true);
+
+	//Power key pulse and setup go on in Dispatch(), the caller is not blocked
+	DEBUG_P(PSTR("Modem Powering ..."LB));
+	digitalWrite(FPowerOnPin, HIGH);
+	NextStartupStage(ssPowerPulse, MODEM_POWERON_PULSE_MS);
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Modem startup, run by Dispatch(). Every stage ends on its deadline, the sketch
+//	loop goes on meanwhile:
+//
+//	ssPowerPulse	power key held down
+//	ssSettle		serial line junk discarded while the module boots
+//	ssSerialSpeed	speed change sent at the module default speed
+//	ssSpeedEcho		command echo discarded at the new speed
+//	ssInitEcho		init sequence echo discarded, then the sequence is committed
+//
+//	meModemReady is posted when the modem accepts the init sequence, otherwise
+//	Error() is set and the staged Recover() takes over
+////////////////////////////////////////////////////////////////////////////////////
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::Startup()
+{
+	FlushSerialInput();
+
+	if(!FStartupTS.IsExpired())
+		return;
 
-	PowerOn();
+	switch(FStartupStage)
+	{
+		case ssPowerPulse:
+			digitalWrite(FPowerOnPin, LOW);
+			DEBUG_P(PSTR("Modem Power is ON"LB));
+			NextStartupStage(ssSettle, MODEM_SETTLE_MS);
+			break;
+		case ssSettle:
+			RequestSerialSpeed();
+			NextStartupStage(ssSerialSpeed, MODEM_SPEED_CHANGE_MS);
+			break;
+		case ssSerialSpeed:
+			ApplySerialSpeed();
+			NextStartupStage(ssSpeedEcho, MODEM_ECHO_DISCARD_MS);
+			break;
+		case ssSpeedEcho:
+			FSerial->print(INIT_SEQUENCE);
+			NextStartupStage(ssInitEcho, MODEM_ECHO_DISCARD_MS);
+			break;
+		case ssInitEcho:
+			FStartupStage = ssReady;
+			FLastKeepAliveTS.Reset();
+
+			if(CommitInitSequence())
+				PostEvent(meModemReady);
+			else
+				SignalError();
+			break;
+	}
+}
 
-	return InnerSetup();
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::NextStartupStage(byte pStage, unsigned int pTimeoutMS)
+{
+	FStartupStage = pStage;
+	FStartupTS.Set(pTimeoutMS);
 }
 
-boolean ModemGSM::HandleURC()
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::HandleURC()
 {
-	FURCQueue.Enqueue(FRXBuff);
+	return FURCQueue.Enqueue(FRXBuff);
 }
 
-boolean ModemGSM::SendSMSAtIndex(int pIndex)
+////////////////////////////////////////////////////////////////////////////////////
+//	Send gate for deferrable SMS: the signal level must reach FSendMinLevel and
+//	must not be falling. A drop counts as falling for SMS_SIGNAL_TREND_MS, then 
+//	the lower level is taken as stable. 
+//	The defer timeout runs from the oldest deferrable SMS queued: after 
+//	SMS_MAX_DEFER_MS the deferrable SMS are sent anyway and urgent ones do not
+//	overtake them anymore
+////////////////////////////////////////////////////////////////////////////////////
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::SendGateOpen()
 {
-	boolean res = false;
+	boolean falling;
 
-	DEBUG_P(PSTR("Sending SMS at index --> %d"LB), pIndex);
+	if(FSMSDeferTS.IsExpired())
+	{
+		DEBUG_P(PSTR("SMS Defer Timeout --> Sending Anyway"LB));
+		return true;
+	}
 
-#if SIMULATION
+	falling = (FPrevSignalLevel != UNKNOWN_LEVEL) && (FSignalLevel < FPrevSignalLevel) && !FSignalChangeTS.IsExpired();
 
-	delay(5000);
+	return (FSignalLevel != UNKNOWN_LEVEL) && (FSignalLevel >= FSendMinLevel) && !falling;
+}
+
+//The defer timeout stops when no deferrable SMS is left
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::UpdateDeferState()
+{
+	int idx;
+
+	for(byte pos = 0; pos < FSMSOutQueue.Count(); pos++)
+		if(FSMSOutQueue.Peek(&idx, pos) && (idx & SMS_DEFERRABLE_FLAG))
+			return;
+
+	FSMSDeferActive = false;
+}
+
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::RecordSendResult(boolean pSuccess)
+{
+	byte level = (FSignalLevel == UNKNOWN_LEVEL) ? 0 : FSignalLevel;
 
-	if(1 || (FSMSResendPending && (FSMSRetry==10)))
+	//Halve counters on overflow, recent results weight more
+	if(FSendAttempts[level] == 0xFF)
 	{
-		FURCQueue.Enqueue("+CMSS: 99");		
-		res = true;
+		FSendAttempts[level] /= 2;
+		FSendOK[level] /= 2;
 	}
-	else
-		FURCQueue.Enqueue("ERROR");
-#else
+
+	FSendAttempts[level]++;
+	if(pSuccess)
+		FSendOK[level]++;
+
+	DEBUG_P(PSTR("SMS Send at level %d --> %d/%d OK"LB), (int)level, (int)FSendOK[level], (int)FSendAttempts[level]);
+
+	TuneSendThreshold();
+}
+
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::TuneSendThreshold()
+{
+	byte level;
+
+	//Lowest known level with a good success rate, levels without enough data are skipped
+	for(level = 1; level < 5; level++)
+	{
+		if(FSendAttempts[level] < SMS_SEND_STATS_MIN_ATTEMPTS)
+		{
+			if(level >= SMS_SEND_MIN_LEVEL)
+				break;
+			continue;
+		}
+
+		if(((unsigned int)FSendOK[level] * 100) >= ((unsigned int)FSendAttempts[level] * SMS_SEND_STATS_MIN_RATE))
+			break;
+	}
+
+	if(level != FSendMinLevel)
+	{
+		DEBUG_P(PSTR("SMS Send Min Level --> %d"LB), (int)level);
+		FSendMinLevel = level;
+	}
+}
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::SendSMSAtIndex(int pIndex)
+{
+	boolean res = false;
+
+	DEBUG_P(PSTR("Sending SMS at index --> %d"LB), pIndex);
+
 	SendCommand(PSTR("AT+CMSS=%d"), pIndex);
 
 	for(;;)
 	{
-		switch(WaitAnswer(45000, true))
+		switch(WaitCommandAnswer(ccSMSSend, true))
 		{
 			case saOk:
 			{
@@ -368,12 +551,11 @@ boolean ModemGSM::SendSMSAtIndex(int pIndex)
 				return false;    
 		}
 	}
-#endif
-
 	return res;
 }
 
-boolean ModemGSM::WriteSMS(const char *pDestPhoneNumber, const char *pBody,int *pIndex)
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::WriteSMS(const char *pDestPhoneNumber, const char *pBody,int *pIndex)
 {
 	boolean res = false;
 
@@ -388,14 +570,15 @@ boolean ModemGSM::WriteSMS(const char *pDestPhoneNumber, const char *pBody,int *
 
 	FSerial->print(pBody);
 
-	delay(500);
+	IdleDelay(500);
 	FSerial->print(0x1A,BYTE);      //CTRL+Z End of Message
+	FCommandTS = millis();
 
 
 	for(;;)
 	{
 		//AT+CMGW can take a long time to answer
-		switch(WaitAnswer(20000))
+		switch(WaitCommandAnswer(ccSMSStore))
 		{
 			case saOk:
 				return res;    
@@ -423,7 +606,8 @@ boolean ModemGSM::WriteSMS(const char *pDestPhoneNumber, const char *pBody,int *
 }
 
 
-boolean ModemGSM::ReadSMSAtIndex(int pIndex, TSMSPtr pSMS)
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::ReadSMSAtIndex(int pIndex, TSMSPtr pSMS)
 {
 	boolean hasEntry = false;
 
@@ -433,7 +617,7 @@ boolean ModemGSM::ReadSMSAtIndex(int pIndex, TSMSPtr pSMS)
 
 	for(;;)
 	{
-		switch(WaitAnswer(5000))
+		switch(WaitCommandAnswer(ccSMSRead))
 		{
 			case saOk:
 				return hasEntry;    
@@ -471,7 +655,8 @@ boolean ModemGSM::ReadSMSAtIndex(int pIndex, TSMSPtr pSMS)
 	}
 }
 
-boolean ModemGSM::DeleteSMSAtIndex(int pIndex)
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::DeleteSMSAtIndex(int pIndex)
 {
 	boolean res = false;
 
@@ -479,202 +664,666 @@ boolean ModemGSM::DeleteSMSAtIndex(int pIndex)
 	
 	SendCommand(PSTR("AT+CMGD=%d"), pIndex);
 
-	return WaitAnswer(10000, true) == saOk;
+	return WaitCommandAnswer(ccSMSRead, true) == saOk;
 }
 
-boolean ModemGSM::SendKeepAlive()
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::DeleteReadSMS()
 {
-	boolean res = false;
+	DEBUG_P(PSTR("Deleting %d read SMS"LB), (int)FReadSMSCount);
 
-	DEBUG_P(PSTR("Sending KeepAlive"LB));
+	//Delete flag 1: read incoming SMS only, unread and outgoing SMS are kept
+	SendCommand(PSTR("AT+CMGD=1,1"));
 
-	SendCommand(PSTR("AT"));
+	//Not retried: what is left is cleared at the next phonebook ready
+	FReadSMSCount = 0;
 
-	return WaitAnswer(1000, true) == saOk;
+	return WaitCommandAnswer(ccSMSStore, true) == saOk;
 }
 
-
-boolean ModemGSM::NumberExistsInPB(const char *pNumber, int *pIndex)
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::TelemetryAppend(byte pType, const byte *pPayload, byte pLen)
 {
-	boolean hasEntry = false;
+	int size = (int)pLen + 2;
+	int drop = 0;
 
-	DEBUG_P(PSTR("Searching Number in PB [1..20] --> %s"LB), pNumber);
+	if(!TelemetrySize || (size > TelemetrySize) || (pLen == 0xFF))
+		return false;
 
-	SendCommand(PSTR("AT+CPBR=1,20"));
+	//Store and forward: the oldest frames make room for the new one
+	for(;(FTelemetryLen - drop + size) > TelemetrySize; drop += FTelemetry[drop] + 1)
+		if(FTelemetryLost < 0xFF)
+			FTelemetryLost++;
 
-	for(int foundIdx = 0;;)
+	if(drop)
 	{
-		switch(WaitAnswer(5000))
-		{
-			case saOk:
-			{
-				if(hasEntry)
-				{
-					DEBUG_P(PSTR("  Number Found at position --> %d"LB), foundIdx);
+		FTelemetryLen -= drop;
+		memmove(FTelemetry, FTelemetry + drop, FTelemetryLen);
+	}
 
-					if(pIndex)
-						*pIndex = foundIdx;
-				}
-				else
-				{
-					DEBUG_P(PSTR("  Number Not Found"LB));
-				}
-				
-				return hasEntry;
+	FTelemetry[FTelemetryLen++] = pLen + 1;
+	FTelemetry[FTelemetryLen++] = pType;
+	memcpy(FTelemetry + FTelemetryLen, pPayload, pLen);
+	FTelemetryLen += pLen;
 
-				break;
-			}
+	return true;
+}
+
+//Final answer of a socket command, the +Uxxx: lines before it are parsed in pValue
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::WaitDataAnswer(int *pValue)
+{
+	for(;;)
+	{
+		switch(WaitCommandDeadline(TELEMETRY_ANSWER_TIMEOUT_MS))
+		{
+			case saOk:
+				return true;
 			case saError:
 			case saTimeout:
-				return false;    
+				return false;
 			case saUnknown:
-			{
-				char number[PHONE_NUMBER_BUFFER_SIZE];
-				int idx;
-
-				if((sscanf_P(FRXBuff,PSTR("+CPBR: %d,\"%20[^\"]\""), &idx, number) == 2))
+				if((FRXBuff[0] == '+') && (FRXBuff[1] == 'U'))
 				{
-					//DEBUG_P("  Checking number --> ");
-					//DEBUG(idx);
-					//DEBUG_P(" : [");
-					//DEBUG(number);
-					//DEBUGLN_P("]");
-					if(!hasEntry)
-					{
-						foundIdx = idx;
-						hasEntry = strcmp(number, pNumber) == 0;
-					}
+					if(pValue)
+						sscanf_P(FRXBuff, PSTR("+%*[^:]: %d"), pValue);
 				}
 				else
 					HandleURC();
-			}		
 		}
 	}
+}
 
-	return false;
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::TelemetryWrite(int pSocket, const byte *pData, int pLen)
+{
+	for(int chunk; pLen; pData += chunk, pLen -= chunk)
+	{
+		chunk = (pLen > TELEMETRY_WRITE_CHUNK) ? TELEMETRY_WRITE_CHUNK : pLen;
+
+		//AT+USOWR=<socket>,<length>,"<hex data>"
+		fprintf_P(&FCommandStream, PSTR("AT+USOWR=%d,%d,\""), pSocket, chunk);
+		for(int i = 0; i < chunk; i++)
+			fprintf_P(&FCommandStream, PSTR("%02X"), pData[i]);
+		SendCommand(PSTR("\""));
+
+		if(!WaitDataAnswer(NULL))
+			return false;
+	}
+
+	return true;
 }
 
-boolean ModemGSM::RegisterNumberInPB(char *pName, char *pNumber)
+////////////////////////////////////////////////////////////////////////////////////
+//	GPRS context up, one TCP connection for the whole batch, context down.
+//	On failure the frames are kept for the next interval
+////////////////////////////////////////////////////////////////////////////////////
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::TelemetryFlush()
 {
-	DEBUG_P(PSTR("Writing PB entry --> "));
+	byte header[6] = {TELEMETRY_MAGIC, TELEMETRY_VERSION, FTelemetrySeq, FTelemetryLost, (byte)FTelemetryLen, (byte)(FTelemetryLen >> 8)};
+	int socket = -1;
+	boolean res = false;
 
-	if(pName)
+	DEBUG_P(PSTR("Telemetry Flush --> %d bytes"LB), FTelemetryLen);
+
+	SendCommand(PSTR("AT+UPSD=0,1,\"" TELEMETRY_APN "\""));
+	if(!WaitDataAnswer(NULL))
+		return false;
+
+	SendCommand(PSTR("AT+UPSDA=0,3"));
+	if(!WaitDataAnswer(NULL))
+		return false;
+
+	SendCommand(PSTR("AT+UDCONF=1,1"));
+	if(WaitDataAnswer(NULL))
 	{
-		DEBUG(pName);
-		DEBUG_P(PSTR(" : "));
+		SendCommand(PSTR("AT+USOCR=6"));
+		if(!WaitDataAnswer(&socket))
+			socket = -1;
 	}
-	DEBUGLN(pNumber);
 
-	if(pName)
-	{	
-		SendCommand(PSTR("AT+CPBW=,\"%s\",,\"%s\""), pNumber, pName);
+	if(socket >= 0)
+	{
+		SendCommand(PSTR("AT+USOCO=%d,\"" TELEMETRY_HOST "\",%d"), socket, TELEMETRY_PORT);
+
+		res = WaitDataAnswer(NULL) && TelemetryWrite(socket, header, sizeof(header)) && TelemetryWrite(socket, FTelemetry, FTelemetryLen);
+
+		SendCommand(PSTR("AT+USOCL=%d"), socket);
+		WaitDataAnswer(NULL);
 	}
-	else
-		SendCommand(PSTR("AT+CPBW=,\"%s\""), pNumber);
 
-	boolean res = WaitAnswer(5000, true) == saOk;
+	SendCommand(PSTR("AT+UPSDA=0,4"));
+	WaitDataAnswer(NULL);
+
+	if(res)
+	{
+		DEBUG_P(PSTR("Telemetry Sent"LB));
+		FTelemetryLen = 0;
+		FTelemetryLost = 0;
+		FTelemetrySeq++;
+	}
+	else
+		DEBUG_P(PSTR("** Telemetry FAIL"LB));
 
-	//Wait a while. It seems that issuing a command immediately after this the modem hangs
-	delay(2000);
-	
 	return res;
 }
 
+////////////////////////////////////////////////////////////////////////////////////
+//	Adaptive keep-alive: any line from the modem proves it is alive and postpones
+//	the probe. The probe interval doubles while probes succeed and falls back to
+//	the minimum after a failure, a timeout or a module reset
+////////////////////////////////////////////////////////////////////////////////////
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::KeepAlive()
+{
+	if(SendKeepAlive())
+	{
+		FError = false;
+		AdaptKeepAlive(true);
+		return true;
+	}
+
+	FKeepAliveFailedCount++;
+	AdaptKeepAlive(false);
+
+	//if the modem is not answering signal it, Recover() will try the hard way ...
+	if(FKeepAliveFailedCount > KEEPALIVE_MAX_FAILED_COUNT)
+	{
+		//Signal Error condition
+		SignalError();
+		return false;
+	}
+
+	return true;
+}
+
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::AdaptKeepAlive(boolean pHealthy)
+{
+	if(!pHealthy)
+		FKeepAliveIntervalMS = KEEPALIVE_MIN_INTERVAL_MS;
+	else if(FKeepAliveIntervalMS < (KEEPALIVE_MAX_INTERVAL_MS / 2))
+		FKeepAliveIntervalMS *= 2;
+	else
+		FKeepAliveIntervalMS = KEEPALIVE_MAX_INTERVAL_MS;
+
+	FLastKeepAliveTS.Set(FKeepAliveIntervalMS);
+}
 
-boolean ModemGSM::GetPBEntryByName(const char *pName, char *pNumber, int *pIndex)
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::NoteModemAlive()
 {
-	boolean hasEntry = false;
+	FKeepAliveFailedCount = 0;
+	FLastKeepAliveTS.Reset();
+}
 
-	DEBUG_P(PSTR("Reading PB entry --> %s"LB), pName);
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::SendKeepAlive()
+{
+	boolean res = false;
 
-	SendCommand(PSTR("AT+CPBF=\"%s\""), pName);
+	DEBUG_P(PSTR("Sending KeepAlive"LB));
+
+	SendCommand(PSTR("AT"));
+
+	return WaitCommandAnswer(ccKeepAlive, true) == saOk;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Phonebook index: the capacity is read with AT+CPBR=? and the entries are 
+//	indexed PB_PAGE_SIZE at a time by Dispatch. A lookup needing the index before
+//	it is complete reads the remaining pages at once
+////////////////////////////////////////////////////////////////////////////////////
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::ResetPBIndex()
+{
+	FPBIndex.Clear();
+	FPBCapacity = 0;
+	FPBNext = 1;
+	FPBIndexReady = false;
+}
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::QueryPBCapacity()
+{
+	int first;
+	int last;
+
+	DEBUG_P(PSTR("Reading PB capacity"LB));
+
+	SendCommand(PSTR("AT+CPBR=?"));
 
 	for(;;)
 	{
-		switch(WaitAnswer(10000))
+		switch(WaitCommandAnswer(ccPhonebook))
 		{
 			case saOk:
-				return hasEntry;    
+				if(!FPBCapacity)
+					FPBCapacity = PB_DEFAULT_CAPACITY;
+
+				DEBUG_P(PSTR("  PB capacity --> %d"LB), (int)FPBCapacity);
+				return true;
 			case saError:
 			case saTimeout:
 				return false;    
 			case saUnknown:
 			{
-				int idx;
-
-				//Stop on first entry. 
-				if(!hasEntry && (sscanf_P(FRXBuff,PSTR("+CPBF: %d,\"%20[^\"]\""), &idx, pNumber) == 2))
-				{
-					DEBUGLN(pNumber);
-					hasEntry = true;
-
-					if(pIndex)
-						*pIndex = idx; 
-				}
+				//+CPBR: (1-250),40,14
+				if(sscanf_P(FRXBuff, PSTR("+CPBR: (%d-%d)"), &first, &last) == 2)
+					FPBCapacity = (last >= PB_MAX_ENTRIES) ? (PB_MAX_ENTRIES - 1) : last;
 				else
 					HandleURC();
-			}
+			}		
 		}
 	}
 }
 
-
-boolean ModemGSM::ClearSMSMemory()
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::IndexPBPage()
 {
-	DEBUG_P(PSTR("Deleting All SMS from SM Memory"LB));
+	int last;
 
-	SendCommand(PSTR("AT+CMGD=0,4"));
+	if(!FPBCapacity)
+		return QueryPBCapacity();
 
-	boolean res = WaitAnswer(20000, true) == saOk;
-	delay(2000);
-	return res;
-}
+	last = FPBNext + PB_PAGE_SIZE - 1;
+	if(last > FPBCapacity)
+		last = FPBCapacity;
 
-boolean ModemGSM::DeletePBEntryAtIndex(byte pIndex)
-{
+	if(!ScanPB(FPBNext, last, NULL, NULL))
+		return false;
+
+	if((FPBNext = last + 1) > FPBCapacity)
+	{
+		FPBIndexReady = true;
+		DEBUG_P(PSTR("PB Indexed --> %d entries%s"LB), (int)FPBIndex.Count(), FPBIndex.IsOverflow() ? " (overflow)" : "");
+	}
+
+	return true;
+}
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::CompletePBIndex()
+{
+	for(;!FPBIndexReady;)
+		if(!IndexPBPage())
+			return false;
+
+	return true;
+}
+
+//Reads the entries pFirst..pLast. pNumber NULL: entries are added to the index, otherwise the first 
+//entry matching the normalized pNumber is returned in pFound (0 if none)
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::ScanPB(int pFirst, int pLast, const char *pNumber, int *pFound)
+{
+	if(pFound)
+		*pFound = 0;
+
+	SendCommand(PSTR("AT+CPBR=%d,%d"), pFirst, pLast);
+
+	for(;;)
+	{
+		switch(WaitCommandAnswer(ccPhonebook))
+		{
+			case saOk:
+				return true;
+			case saError:
+				//Some modems answer "not found" (CME error 22) to an empty range
+				return (strcmp_P(FRXBuff, PSTR("+CME ERROR: 22")) == 0) || (strcmp_P(FRXBuff, PSTR("+CME ERROR: not found")) == 0);
+			case saTimeout:
+				return false;    
+			case saUnknown:
+			{
+				char number[PHONE_NUMBER_BUFFER_SIZE];
+				char normalized[PHONE_NUMBER_BUFFER_SIZE];
+				int idx;
+
+				if((sscanf_P(FRXBuff,PSTR("+CPBR: %d,\"%20[^\"]\""), &idx, number) == 2))
+				{
+					PhonebookIndex::Normalize(number, normalized, sizeof(normalized));
+
+					if(!pNumber)
+						FPBIndex.Add(PhonebookIndex::Hash(normalized), idx);
+					else if(!*pFound && (strcmp(normalized, pNumber) == 0))
+						*pFound = idx;
+				}
+				else
+					HandleURC();
+			}		
+		}
+	}
+}
+
+template <class TSerial, class TConfig>
+typename ModemGSMBase<TSerial, TConfig>::EPBLookup ModemGSMBase<TSerial, TConfig>::LookupNumberInPB(const char *pNumber, int *pIndex)
+{
+	char normalized[PHONE_NUMBER_BUFFER_SIZE];
+	unsigned int hash;
+	int found = 0;
+
+	PhonebookIndex::Normalize(pNumber, normalized, sizeof(normalized));
+	hash = PhonebookIndex::Hash(normalized);
+
+	DEBUG_P(PSTR("Searching Number in PB --> %s"LB), normalized);
+
+	if(!CompletePBIndex())
+	{
+		DEBUG_P(PSTR("** PB Not Readable"LB));
+		return plError;
+	}
+
+	if(FPBIndex.IsOverflow())
+	{
+		//More numbers than the index holds: the whole SIM is scanned, a page per command
+		for(int first = 1; !found && (first <= FPBCapacity); first += PB_PAGE_SIZE)
+			if(!ScanPB(first, min(first + PB_PAGE_SIZE - 1, (int)FPBCapacity), normalized, &found))
+				return plError;
+	}
+	else
+	{
+		//Every candidate with the same hash is confirmed on the SIM
+		for(int pos = FPBIndex.Find(hash); !found && (pos >= 0) && (pos < FPBIndex.Count()) && (FPBIndex.HashAt(pos) == hash); pos++)
+			if(!ScanPB(FPBIndex.IndexAt(pos), FPBIndex.IndexAt(pos), normalized, &found))
+				return plError;
+	}
+
+	if(found)
+	{
+		DEBUG_P(PSTR("  Number Found at position --> %d"LB), found);
+
+		if(pIndex)
+			*pIndex = found;
+	}
+	else
+	{
+		DEBUG_P(PSTR("  Number Not Found"LB));
+	}
+
+	return found ? plFound : plNotFound;
+}
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::RegisterNumberInPB(const char *pName, const char *pNumber)
+{
+	byte idx;
+
+	DEBUG_P(PSTR("Writing PB entry --> "));
+
+	if(pName)
+	{
+		DEBUG(pName);
+		DEBUG_P(PSTR(" : "));
+	}
+	DEBUGLN(pNumber);
+
+	//The first free position comes from the index, the SIM is not scanned
+	if(!CompletePBIndex() || !(idx = FPBIndex.FirstFree(FPBCapacity)))
+	{
+		DEBUG_P(PSTR("** PB Full"LB));
+		return false;
+	}
+
+	if(pName)
+	{	
+		SendCommand(PSTR("AT+CPBW=%d,\"%s\",,\"%s\""), (int)idx, pNumber, pName);
+	}
+	else
+		SendCommand(PSTR("AT+CPBW=%d,\"%s\""), (int)idx, pNumber);
+
+	boolean res = WaitCommandAnswer(ccPhonebook, true) == saOk;
+
+	if(res)
+	{
+		char normalized[PHONE_NUMBER_BUFFER_SIZE];
+
+		PhonebookIndex::Normalize(pNumber, normalized, sizeof(normalized));
+		FPBIndex.Add(PhonebookIndex::Hash(normalized), idx);
+	}
+
+	//Wait a while. It seems that issuing a command immediately after this the modem hangs
+	IdleDelay(2000);
+	
+	return res;
+}
+
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::GetPBEntryByName(const char *pName, char *pNumber, int *pIndex)
+{
+	boolean hasEntry = false;
+
+	DEBUG_P(PSTR("Reading PB entry --> %s"LB), pName);
+
+	SendCommand(PSTR("AT+CPBF=\"%s\""), pName);
+
+	for(;;)
+	{
+		switch(WaitCommandAnswer(ccPhonebook))
+		{
+			case saOk:
+				return hasEntry;    
+			case saError:
+			case saTimeout:
+				return false;    
+			case saUnknown:
+			{
+				int idx;
+
+				//Stop on first entry. 
+				if(!hasEntry && (sscanf_P(FRXBuff,PSTR("+CPBF: %d,\"%20[^\"]\""), &idx, pNumber) == 2))
+				{
+					DEBUGLN(pNumber);
+					hasEntry = true;
+
+					if(pIndex)
+						*pIndex = idx; 
+				}
+				else
+					HandleURC();
+			}
+		}
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Modem clock, set by the network: +CCLK: "yy/MM/dd,hh:mm:ss+zz"
+//	Day of week is 0 for Monday. A clock never set by the network is rejected
+////////////////////////////////////////////////////////////////////////////////////
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::GetNetworkTime(byte *pDayOfWeek, byte *pHour, byte *pMinute)
+{
+	boolean hasTime = false;
+
+	DEBUG_P(PSTR("Reading Network Time"LB));
+
+	SendCommand(PSTR("AT+CCLK?"));
+
+	for(;;)
+	{
+		switch(WaitCommandAnswer(ccClock))
+		{
+			case saOk:
+				return hasTime;    
+			case saError:
+			case saTimeout:
+				return false;    
+			case saUnknown:
+			{
+				int year, month, day, hour, minute;
+
+				if(sscanf_P(FRXBuff, PSTR("+CCLK: \"%d/%d/%d,%d:%d"), &year, &month, &day, &hour, &minute) == 5)
+				{
+					DEBUG_P(PSTR("  Network Time --> %s"LB), FRXBuff);
+
+					//Modem default clock, not set by the network
+					if((year < 11) || (month < 1) || (month > 12))
+						break;
+
+					//Sakamoto's method, 0 = Sunday
+					year += 2000;
+					if(month < 3)
+						year--;
+					*pDayOfWeek = ((year + year / 4 - year / 100 + year / 400 + pgm_read_byte(&MonthOffset[month - 1]) + day) % 7 + 6) % 7;
+					*pHour = hour;
+					*pMinute = minute;
+					hasTime = true;
+				}
+				else
+					HandleURC();
+			}
+		}
+	}
+}
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::ClearSMSMemory()
+{
+	DEBUG_P(PSTR("Deleting All SMS from SM Memory"LB));
+
+	SendCommand(PSTR("AT+CMGD=0,4"));
+
+	boolean res = WaitCommandAnswer(ccSMSStore, true) == saOk;
+
+	//The modem is busy for a while after deleting all messages
+	WaitReady(2000);
+	return res;
+}
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::WaitReady(unsigned int pTimeoutMS)
+{
+	unsigned long ts = millis();
+
+	//Poll the modem until it answers instead of sleeping for the worst case
+	IdleDelay(MODEM_READY_SETTLE_MS);
+
+	for(;SafeSub(millis(), ts) < pTimeoutMS;)
+	{
+		SendCommand(PSTR("AT"));
+
+		if(WaitAnswer(MODEM_READY_PROBE_MS, true) == saOk)
+			return true;
+	}
+
+	DEBUG_P(PSTR("** Modem Not Ready"LB));
+	return false;
+}
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::DeletePBEntryAtIndex(byte pIndex)
+{
 	DEBUG_P(PSTR("Deleting PB entry at --> %d"LB), pIndex);
 
 	SendCommand(PSTR("AT+CPBW=%d"), (int) pIndex);
 
-	return WaitAnswer(1000, true) == saOk;
+	if(WaitCommandAnswer(ccPhonebook, true) != saOk)
+		return false;
+
+	FPBIndex.Remove(pIndex);
+	return true;
 }
 
-boolean ModemGSM::InnerSetup()
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::PostEvent(byte pType, int pValue)
 {
-	boolean res;
+	if(!FEvents.Post(pType, pValue))
+		DEBUG_P(PSTR("** Event Queue Full --> %d Lost"LB), (int)pType);
+}
+
+//Events on the transitions only
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::SetRegistered(boolean pRegistered)
+{
+	if(pRegistered != FRegisteredToNetwork)
+		PostEvent(pRegistered ? meRegistered : meDeregistered);
+
+	FRegisteredToNetwork = pRegistered;
+}
+
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::SignalError()
+{
+	//Level triggered, read by the application through Error()
+	FError = true;
+}
+
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::ResetState(boolean pCold)
+{
+	FError = false;
+	FKeepAliveFailedCount = 0;
+
+	//Warm restart: the modem kept registration, phonebook and stored SMS
+	if(!pCold)
+		return;
 
 	FSMSResendPending = false;
+	FReadSMSCount = 0;
 
 	FSMSOutQueue.Clear();
 	FSMSInQueue.Clear();
 
-	FRegisteredToNetwork = false;
+	SetRegistered(false);
 	FSignalLevel = UNKNOWN_LEVEL;
+	FPrevSignalLevel = UNKNOWN_LEVEL;
 	FPBReady = false;
-	FError = false;
-	FKeepAliveFailedCount = 0;
-
-
-#ifdef REGISTRATION_DELAYED
+	ResetPBIndex();
+	FSMSDeferActive = false;
 	FNetworkRegDelayActive = false;
-#endif
+}
 
-	DiscardSerialInput(2000);               //Discard serial line junk
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::FlushSerialInput()
+{
+	for(;FSerial->available() > 0;)
+		FSerial->read();
+}
 
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::RequestSerialSpeed()
+{
 	//Inizializziamo la seriale Hardware con il Baud rate imposto dal Modem GSM    
 	FSerial->end();
 	FSerial->begin(MODEM_SERIAL_BAUD_RATE);          
 	
 	SendCommand(PSTR("AT+IPR=9600"));
+}
 
-	delay(500);
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::ApplySerialSpeed()
+{
 	FSerial->end();
 	FSerial->begin(9600);          
-	DiscardSerialInput(500);                //discard the command ECHO (initialization will disable command echo)
 	DEBUG_P(PSTR("Serial Speed 9600"LB));
-	
+}
+
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::SetupSerialSpeed()
+{
+	RequestSerialSpeed();
+	IdleDelay(MODEM_SPEED_CHANGE_MS);
+	ApplySerialSpeed();
+	DiscardSerialInput(MODEM_ECHO_DISCARD_MS);	//discard the command ECHO (initialization will disable command echo)
+}
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::ApplyInitSequence(unsigned int pEchoDiscardMS)
+{
 	FSerial->print(INIT_SEQUENCE);			//Send initialization sequence to modem
-	DiscardSerialInput(500);                //discard the command ECHO (initialization will disable command echo)
+	DiscardSerialInput(pEchoDiscardMS);     //discard the command ECHO (initialization will disable command echo)
+
+	return CommitInitSequence();
+}
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::CommitInitSequence()
+{
+	boolean res;
+
 	FSerial->print("\r");                   //Commit
 
 	res = WaitAnswer(1000, true) == saOk;
@@ -689,14 +1338,173 @@ boolean ModemGSM::InnerSetup()
 	return res;
 }
 
-void ModemGSM::PowerOn()
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::QueryNetworkRegistration()
+{
+	SendCommand(PSTR("AT+CREG?"));
+
+	for(;;)
+	{
+		switch(WaitCommandDeadline(1000))
+		{
+			case saOk:
+				return FRegisteredToNetwork;    
+			case saError:
+			case saTimeout:
+				return false;    
+			case saUnknown:
+			{
+				int stat;
+
+				//Solicited answer is +CREG: <n>,<stat>
+				if(sscanf_P(FRXBuff, PSTR("+CREG: %*d,%d"), &stat) == 1)
+				{
+					//The modem was already registered: no need to wait for the registration delay
+					SetRegistered((stat == 1) || (stat == 5));
+					FNetworkRegDelayActive = false;
+					DEBUG_P(PSTR("Network Registration Status --> %d"LB), stat);
+				}
+				else
+					HandleURC();
+			}
+		}
+	}
+}
+
+//The phonebook answers only when the SIM is ready
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::QueryPBReady()
+{
+	boolean ready;
+
+	ResetPBIndex();
+	ready = QueryPBCapacity();
+
+	if(ready && !FPBReady)
+		PostEvent(mePBReady);
+
+	FPBReady = ready;
+	return ready;
+}
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::InnerSetup()
+{
+	ResetState(true);
+
+	//Bounded setup, about 4 s
+	WATCHDOG_RESET();
+	DiscardSerialInput(MODEM_SETTLE_MS);	//Discard serial line junk
+
+	SetupSerialSpeed();
+
+	return ApplyInitSequence(MODEM_ECHO_DISCARD_MS);
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Staged modem recovery, cheapest stage first:
+//
+//	rsWarm			the modem answers AT: re-apply the init sequence only and keep
+//					registration, phonebook and queued SMS
+//	rsSerial		no answer: the module may have restarted at its default speed,
+//					redo the baud rate setup without touching the power. Registration
+//					and phonebook state are read back, queued SMS are kept
+//	rsPowerCycle	last resort: power off, power pulse and full setup
+//
+//	The elapsed time of every attempted stage is kept for diagnostics
+////////////////////////////////////////////////////////////////////////////////////
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::Recover()
+{
+	unsigned long ts;
+	boolean res;
+
+	memset(FRecoveryStageMS, 0, sizeof(FRecoveryStageMS));
+	//Replaces a startup still in progress
+	FStartupStage = ssReady;
+
+	DEBUG_P(PSTR("Modem Recovery --> Warm"LB));
+
+	WATCHDOG_RESET();
+	ts = millis();
+	FlushSerialInput();
+
+	if(res = SendKeepAlive())
+	{
+		ResetState(false);
+
+		if(res = ApplyInitSequence(0))
+			QueryNetworkRegistration();
+	}
+
+	FRecoveryStageMS[rsWarm] = SafeSub(millis(), ts);
+	FLastRecoveryStage = rsWarm;
+
+	if(!res)
+	{
+		DEBUG_P(PSTR("Modem Recovery --> Serial"LB));
+
+		WATCHDOG_RESET();
+		ts = millis();
+		ResetState(false);
+		DiscardSerialInput(MODEM_ECHO_DISCARD_MS);
+		SetupSerialSpeed();
+
+		//If the module did not restart no +CREG or +PBREADY will come
+		if(res = ApplyInitSequence(MODEM_ECHO_DISCARD_MS))
+		{
+			QueryNetworkRegistration();
+			QueryPBReady();
+		}
+
+		FRecoveryStageMS[rsSerial] = SafeSub(millis(), ts);
+		FLastRecoveryStage = rsSerial;
+	}
+
+	if(!res)
+	{
+		DEBUG_P(PSTR("Modem Recovery --> Power Cycle"LB));
+
+		WATCHDOG_RESET();
+		ts = millis();
+
+		//Try to power off the modem
+		SendCommand(PSTR("AT+CPWROFF"));
+		IdleDelay(MODEM_POWEROFF_DELAY_MS);
+
+		PowerOn();
+		//InnerSetup() feeds the watchdog again
+		res = InnerSetup();
+
+		FRecoveryStageMS[rsPowerCycle] = SafeSub(millis(), ts);
+		FLastRecoveryStage = rsPowerCycle;
+	}
+
+	FLastKeepAliveTS.Reset();
+
+	DEBUG_P(PSTR("Modem Recovery %s at stage %d --> %lu ms"LB), (res ? "OK" : "FAIL"), (int)FLastRecoveryStage, FRecoveryStageMS[FLastRecoveryStage]);
+
+	//A failure is not published: the caller retries the recovery
+	if(res)
+		PostEvent(meModemReset, FLastRecoveryStage);
+	else
+		FError = true;
+
+	return res;
+}
+
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::PowerOn()
 {
 	DEBUG_P(PSTR("Modem Powering ..."LB));
-	PulseOut(FPowerOnPin, MODEM_POWERON_PULSE_MS);   
+	digitalWrite(FPowerOnPin, HIGH);
+	IdleDelay(MODEM_POWERON_PULSE_MS);
+	digitalWrite(FPowerOnPin, LOW);
 	DEBUG_P(PSTR("Modem Power is ON"LB));
 }
 
-int ModemGSM::Readln(unsigned int pTimeout, boolean pIgnoreLeadingLF)
+template <class TSerial, class TConfig>
+int ModemGSMBase<TSerial, TConfig>::Readln(unsigned int pTimeout, boolean pIgnoreLeadingLF)
 {
 	unsigned long ts = millis();
 	byte count = 0;
@@ -720,6 +1528,9 @@ int ModemGSM::Readln(unsigned int pTimeout, boolean pIgnoreLeadingLF)
 	
 	for(;;)
 	{
+		if(FIdleCallback)
+			FIdleCallback();
+
 		if(FSerial->available() > 0)
 		{
 			char c;
@@ -741,6 +1552,9 @@ int ModemGSM::Readln(unsigned int pTimeout, boolean pIgnoreLeadingLF)
 				if(hasLeadingCRLF)
 				{
 					FRXBuff[count] = '\0';
+
+					//A complete line proves the modem is alive
+					NoteModemAlive();
 					//DEBUG_P(PSTR("ReadLine ["));
 					//DEBUG(FRXBuff);
 					//DEBUG_P(PSTR("]"LB));
@@ -756,17 +1570,22 @@ int ModemGSM::Readln(unsigned int pTimeout, boolean pIgnoreLeadingLF)
 		else
 		{
 			if(SafeSub(millis(), ts) > pTimeout)
+			{
+				FRXBuff[count] = '\0';
 				return count;
+			}
 		}
 	}
 }
 
-int ModemGSM::SMSCount(EQueue pQueue) 
+template <class TSerial, class TConfig>
+int ModemGSMBase<TSerial, TConfig>::SMSCount(EQueue pQueue) 
 {
 	return (pQueue == qIn ? FSMSInQueue.Count() : FSMSOutQueue.Count()); 
 };
 
-boolean ModemGSM::SMSDequeue(EQueue pQueue, TSMSPtr pItem) 
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::SMSDequeue(EQueue pQueue, TSMSPtr pItem) 
 { 
 	int idx;
 	boolean res = false;
@@ -780,10 +1599,16 @@ boolean ModemGSM::SMSDequeue(EQueue pQueue, TSMSPtr pItem)
 
 	if(res = (pQueue == qIn ? FSMSInQueue.Dequeue(&idx) : FSMSOutQueue.Dequeue(&idx)))
 	{
+		idx &= ~SMS_DEFERRABLE_FLAG;
+
 		if(pItem)
 			if(!(res = ReadSMSAtIndex(idx, pItem)))
 				DEBUG_P(PSTR("ReadSMSAtIndex FAIL"LB));
-		if(res)
+
+		//Incoming SMS are marked as read by the modem and deleted later in bulk
+		if(res && (pQueue == qIn))
+			FReadSMSCount++;
+		else if(res)
 			if(!(res = DeleteSMSAtIndex(idx)))
 				DEBUG_P(PSTR("DeleteSMSAtIndex FAIL"LB));
 	}
@@ -798,26 +1623,78 @@ boolean ModemGSM::SMSDequeue(EQueue pQueue, TSMSPtr pItem)
 	return res;
 }
 
-void ModemGSM::SendCommand(const char *__fmt, ...)
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::SendCommand(const char *__fmt, ...)
 {
-	char buffer[101];
 	va_list arglist;
+
+	DrainInput();
 	
+	//Formatted straight to the modem: no buffer on the stack
 	va_start( arglist, __fmt );
-    vsprintf_P(buffer, __fmt, arglist );
+    vfprintf_P(&FCommandStream, __fmt, arglist );
     va_end( arglist );	
 
-	FSerial->println(buffer);
+	FSerial->println();
+	FCommandTS = millis();
 }
 
-boolean ModemGSM::SendSMS(const char *pDestPhoneNumber, const char *pBody)
+////////////////////////////////////////////////////////////////////////////////////
+//	A late answer to a timed out command must not be taken as the answer to the
+//	next one: what is pending is read before a command is sent. Final answers are
+//	dropped, any other line is kept as URC
+////////////////////////////////////////////////////////////////////////////////////
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::DrainInput()
+{
+	unsigned long ts = millis();
+
+	//Bounded: a modem sending without pause can not hold the command back
+	for(;(FSerial->available() > 0) && (SafeSub(millis(), ts) < WATCHDOG_SLICE_MS);)
+	{
+		if(Readln(MODEM_DRAIN_TIMEOUT_MS, false) == TIMEOUT)
+			break;
+
+		if(ParseAnswer() == saUnknown)
+			HandleURC();
+		else
+		{
+			DEBUG_P(PSTR("** Stale Answer --> "));
+			DEBUGLN(FRXBuff);
+		}
+	}
+}
+
+template <class TSerial, class TConfig>
+boolean ModemGSMBase<TSerial, TConfig>::SendSMS(const char *pDestPhoneNumber, const char *pBody, boolean pDeferrable)
 {   
 	boolean res = false;
 	int idx;
 
 	if(res = WriteSMS(pDestPhoneNumber, pBody, &idx))
 	{
-		res = FSMSOutQueue.Enqueue(idx);
+		if(pDeferrable)
+		{
+			if((res = FSMSOutQueue.Enqueue(idx | SMS_DEFERRABLE_FLAG)) && !FSMSDeferActive)
+			{
+				FSMSDeferActive = true;
+				FSMSDeferTS.Reset();
+			}
+		}
+		else
+		{
+			int queued;
+			//Urgent SMS go after other urgent ones but before deferrable ones. Do not overtake a retry in progress
+			byte pos = FSMSResendPending ? 1 : 0;
+
+			//Deferrable SMS waiting for too long are not overtaken
+			if(FSMSDeferActive && FSMSDeferTS.IsExpired())
+				pos = FSMSOutQueue.Count();
+
+			for(;(pos < FSMSOutQueue.Count()) && FSMSOutQueue.Peek(&queued, pos) && !(queued & SMS_DEFERRABLE_FLAG); pos++);
+
+			res = FSMSOutQueue.Insert(pos, idx);
+		}
 		if(res)
 		{
 			DEBUG_P(PSTR("SMS Enqueue OK index --> %d"LB), idx);
@@ -829,32 +1706,54 @@ boolean ModemGSM::SendSMS(const char *pDestPhoneNumber, const char *pBody)
 	return res;
 }
 
-ModemGSM::EStandardAnswer ModemGSM::WaitAnswer(unsigned int pTimeoutMS, boolean pHandleURC)
+template <class TSerial, class TConfig>
+typename ModemGSMBase<TSerial, TConfig>::EStandardAnswer ModemGSMBase<TSerial, TConfig>::ParseAnswer()
 {
+	if(strcmp_P(FRXBuff,PSTR("OK")) == 0)
+		return saOk;    
+
+	if(	(strcmp_P(FRXBuff,PSTR("ERROR")) == 0) ||
+		(strncmp_P(FRXBuff,PSTR("+CME ERROR:"), 11) == 0) ||
+		(strncmp_P(FRXBuff,PSTR("+CMS ERROR:"), 11) == 0))
+		return saError;    
+
+	return saUnknown;
+}
+
+//pTimeoutMS bounds the whole wait: lines that are not the answer do not extend it
+template <class TSerial, class TConfig>
+typename ModemGSMBase<TSerial, TConfig>::EStandardAnswer ModemGSMBase<TSerial, TConfig>::WaitAnswer(unsigned int pTimeoutMS, boolean pHandleURC)
+{
+	unsigned long ts = millis();
+
 	//DEBUG_P("WaitAnswer --> ");
 	for(;;)
 	{
-		if(Readln(pTimeoutMS, false) == TIMEOUT)
+		unsigned long elapsed = SafeSub(millis(), ts);
+		EStandardAnswer res;
+
+		if(elapsed >= pTimeoutMS)
 		{
 			DEBUG_P(PSTR("** TIMEOUT"LB));
 			return saTimeout;
 		}
+
+		//The wait has a bound: the watchdog is fed once per slice
+		WATCHDOG_RESET();
+
+		if(Readln(min(pTimeoutMS - elapsed, WATCHDOG_SLICE_MS), false) == TIMEOUT)
+			continue;
 		
 		//DEBUGLN(FRXBuff);
 
-		if(strcmp_P(FRXBuff,PSTR("OK")) == 0)
-		{
-			//DEBUGLN_P("OK");
-			return saOk;    
-		}
-		else if(	(strcmp_P(FRXBuff,PSTR("ERROR")) == 0) ||
-					(strncmp_P(FRXBuff,PSTR("+CME ERROR:"), 11) == 0) ||
-					(strncmp_P(FRXBuff,PSTR("+CMS ERROR:"), 11) == 0))
+		if((res = ParseAnswer()) == saError)
 		{
 			DEBUG_P(PSTR("** "));
 			DEBUGLN(FRXBuff);
-			return saError;    
 		}
+
+		if(res != saUnknown)
+			return res;
 		else if(pHandleURC)
 			HandleURC();
 		else
@@ -862,6 +1761,104 @@ ModemGSM::EStandardAnswer ModemGSM::WaitAnswer(unsigned int pTimeoutMS, boolean
 	}
 }
 
+//Answer to the last command, pTimeoutMS counted from the moment it was sent
+template <class TSerial, class TConfig>
+typename ModemGSMBase<TSerial, TConfig>::EStandardAnswer ModemGSMBase<TSerial, TConfig>::WaitCommandDeadline(unsigned int pTimeoutMS, boolean pHandleURC)
+{
+	unsigned long elapsed = SafeSub(millis(), FCommandTS);
+
+	if(elapsed >= pTimeoutMS)
+	{
+		DEBUG_P(PSTR("** TIMEOUT"LB));
+		return saTimeout;
+	}
+
+	return WaitAnswer(pTimeoutMS - elapsed, pHandleURC);
+}
+
+
+template <class TSerial, class TConfig>
+unsigned int ModemGSMBase<TSerial, TConfig>::CommandTimeout(ECommandClass pClass)
+{
+	return FLatency[pClass].GetTimeout(pgm_read_word(&CommandTimeouts[pClass][0]), 
+		pgm_read_word(&CommandTimeouts[pClass][1]), pgm_read_word(&CommandTimeouts[pClass][2]));
+}
+
+template <class TSerial, class TConfig>
+typename ModemGSMBase<TSerial, TConfig>::EStandardAnswer ModemGSMBase<TSerial, TConfig>::WaitCommandAnswer(ECommandClass pClass, boolean pHandleURC)
+{
+	EStandardAnswer res = WaitCommandDeadline(CommandTimeout(pClass), pHandleURC);
+
+	switch(res)
+	{
+		//The modem answered: learn from the time elapsed since the command was sent
+		case saOk:
+		case saError:
+		{
+			unsigned long elapsed = SafeSub(millis(), FCommandTS);
+
+			FLatency[pClass].Update(elapsed > 0xFFFF ? 0xFFFF : (unsigned int)elapsed);
+			break;
+		}
+		case saTimeout:
+			FLatency[pClass].Backoff();
+			AdaptKeepAlive(false);
+			DEBUG_P(PSTR("** Class %d timeout now --> %u ms"LB), (int)pClass, CommandTimeout(pClass));
+			break;
+	}
+
+	return res;
+}
+
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::LoadLatencyTable()
+{
+	byte *data = (byte *)FLatency;
+	byte sum = LATENCY_EEPROM_MAGIC;
+
+	for(int i = 0; i < sizeof(FLatency); i++)
+		sum += (data[i] = EEPROM.read(LATENCY_EEPROM_START_ADDRESS + 1 + i));
+
+	//Magic byte and checksum, fall back to the default timeouts if not valid
+	if((EEPROM.read(LATENCY_EEPROM_START_ADDRESS) != LATENCY_EEPROM_MAGIC) ||
+		(EEPROM.read(LATENCY_EEPROM_START_ADDRESS + 1 + sizeof(FLatency)) != sum))
+	{
+		DEBUG_P(PSTR("Latency Table Not Valid --> Defaults"LB));
+
+		for(byte i = 0; i < ccCount; i++)
+			FLatency[i].Clear();
+	}
+	else
+	{
+		for(byte i = 0; i < ccCount; i++)
+			DEBUG_P(PSTR("Class %d Latency --> %u +/- %u ms"LB), (int)i, FLatency[i].SRTT(), FLatency[i].RTTVar());
+	}
+}
+
+template <class TSerial, class TConfig>
+void ModemGSMBase<TSerial, TConfig>::SaveLatencyTable()
+{
+	byte *data = (byte *)FLatency;
+	byte sum = LATENCY_EEPROM_MAGIC;
+	int i;
+
+	DEBUG_P(PSTR("Saving Latency Table"LB));
+
+	//Write only the cells that changed
+	if(EEPROM.read(LATENCY_EEPROM_START_ADDRESS) != LATENCY_EEPROM_MAGIC)
+		EEPROM.write(LATENCY_EEPROM_START_ADDRESS, LATENCY_EEPROM_MAGIC);
+
+	for(i = 0; i < sizeof(FLatency); i++)
+	{
+		sum += data[i];
+
+		if(EEPROM.read(LATENCY_EEPROM_START_ADDRESS + 1 + i) != data[i])
+			EEPROM.write(LATENCY_EEPROM_START_ADDRESS + 1 + i, data[i]);
+	}
+
+	if(EEPROM.read(LATENCY_EEPROM_START_ADDRESS + 1 + i) != sum)
+		EEPROM.write(LATENCY_EEPROM_START_ADDRESS + 1 + i, sum);
+}
 
 template <int i>
 boolean URCQueue<i>::Enqueue(const char *pURCText)
@@ -938,6 +1935,12 @@ void URCQueue<i>::Clear()
 
 template <int i>
 boolean SMSIndexQueue<i>::Enqueue(int pIndex)
+{
+	return Insert(FCount, pIndex);
+};
+
+template <int i>
+boolean SMSIndexQueue<i>::Insert(byte pPos, int pIndex)
 {
 	if(FCount >= i)
 	{
@@ -945,9 +1948,14 @@ boolean SMSIndexQueue<i>::Enqueue(int pIndex)
 		return false;
 	}
 
-	FSMSQueue[FCount] = pIndex;
+	if(pPos > FCount)
+		pPos = FCount;
+
+	memmove(FSMSQueue + pPos + 1, FSMSQueue + pPos, sizeof(int) * (FCount - pPos));
+	FSMSQueue[pPos] = pIndex;
 
 	FCount++;    
+	return true;
 };
 
 template <int i>
@@ -978,18 +1986,60 @@ void SMSIndexQueue<i>::Clear()
 };
 
 template <int i>
-boolean SMSIndexQueue<i>::Peek(int *pIndex)
+boolean SMSIndexQueue<i>::Peek(int *pIndex, byte pPos)
 { 
-	if(FCount == 0)
+	if(pPos >= FCount)
 	{
-		DEBUG_P(PSTR("** Peek: SMS Queue is Empty"LB));
+		if(pPos == 0)
+			DEBUG_P(PSTR("** Peek: SMS Queue is Empty"LB));
 		return false;
 	}
 
 	if(pIndex)
 	{
-		*pIndex = FSMSQueue[0];
+		*pIndex = FSMSQueue[pPos];
 	}
 
 	return true;    
 };
+
+template <int i>
+boolean EventQueue<i>::Post(byte pType, int pValue)
+{
+	TModemEvent *event;
+
+	if(FCount == i)
+		return false;
+
+	event = &FEvents[(FHead + FCount) % i];
+	event->type = pType;
+	event->value = pValue;
+	FCount++;
+
+	return true;
+}
+
+template <int i>
+boolean EventQueue<i>::Get(TModemEvent *pEvent)
+{
+	if(FCount == 0)
+		return false;
+
+	*pEvent = FEvents[FHead];
+	FHead = (FHead + 1) % i;
+	FCount--;
+
+	return true;
+}
+
+template <int i>
+void EventQueue<i>::Clear()
+{
+	FHead = 0;
+	FCount = 0;
+}
+
+//Modem type used by the sketch
+template class ModemGSMBase<MODEM_SERIAL_CLASS, ModemConfig>;
+//Called by the inline GetEvent(): the compiler may inline it above and not emit it
+template class EventQueue<ModemConfig::EventQueueSize>;
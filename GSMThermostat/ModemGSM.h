@@ -2,24 +2,48 @@
 #define __MODEMGSM
 #include "WProgram.h"
 #include "Timeout.h"
-
-#define SIMULATION						false
-
-#define RX_BUFFER_SIZE					163
+#include "LatencyEstimator.h"
+#include "PhonebookIndex.h"
+#include "PinConfig.h"
+#include "FakeModemSerial.h"
 
 #define SMS_TEXT_BUFFER_SIZE			161
 #define PHONE_NUMBER_BUFFER_SIZE		21
 #define MODEM_SERIAL_BAUD_RATE			115200
-#define SMS_IN_QUEUE_MAX_ITEM_COUNT		10
-#define SMS_OUT_QUEUE_MAX_ITEM_COUNT	10
-#define URC_QUEUE_MAX_ITEM_COUNT		10
 #define MODEM_POWERON_PULSE_MS			2000
+#define MODEM_SETTLE_MS					2000	//Serial line junk discarded after the power on
+#define MODEM_SPEED_CHANGE_MS			500
+#define MODEM_ECHO_DISCARD_MS			500
 #define NETWORK_LED_UPDATE_INTERVAL_MS	5000
-#define NETWORK_REGISTRAION_DELAY_MS	15000
+#define MODEM_POWEROFF_DELAY_MS			1000
+#define MODEM_READY_SETTLE_MS			250
+#define MODEM_READY_PROBE_MS			250
+#define MODEM_DRAIN_TIMEOUT_MS			50		//Idle time ending a pending line read before a command
+#define LATENCY_EEPROM_START_ADDRESS	5		//Learned AT command latencies (the Pin uses addresses 1..4, the state store starts at 32)
+#define LATENCY_EEPROM_MAGIC			0xA6	//Changed with the command classes, a table of another layout is not loaded
+#define LATENCY_SAVE_INTERVAL_MS		((unsigned long)1000*60*60*6)
+#define KEEPALIVE_INTERVAL_MS			15000
+#define KEEPALIVE_MIN_INTERVAL_MS		5000
+#define KEEPALIVE_MAX_INTERVAL_MS		60000
+#define KEEPALIVE_MAX_FAILED_COUNT		5
 #define SMS_RETRY_COUNT					12
 #define SMS_RETRY_DELAY_MS				15000 //Total Retry time = 12*15 seconds --> 3 minutes
-
-#define REGISTRATION_DELAYED			//Enables a delay before assuming to be registered to network
+#define SMS_DEFERRABLE_FLAG				0x4000	//Out queue index flag: the SMS can wait for a better signal
+#define SMS_MAX_DEFER_MS				((unsigned long)1000*60*10)
+#define SMS_SIGNAL_TREND_MS				60000	//A signal drop counts as falling for this time
+#define SMS_SEND_MIN_LEVEL				2		//Default minimum signal level for deferrable SMS
+#define SMS_SEND_STATS_MIN_ATTEMPTS		4		//Attempts at a level before its success rate is trusted
+#define SMS_SEND_STATS_MIN_RATE			75		//Success rate (%) for a level to be considered good
+#define PB_PAGE_SIZE					10		//Phonebook entries read by each Dispatch while the index is built
+#define PB_DEFAULT_CAPACITY				20		//Used if the SIM does not report its capacity
+#define SMS_BULK_DELETE_COUNT			5		//Incoming SMS already read, deleted together when the queue is empty or at this count
+#define TELEMETRY_APN					"internet"
+#define TELEMETRY_HOST					"192.168.1.10"
+#define TELEMETRY_PORT					5000
+#define TELEMETRY_ANSWER_TIMEOUT_MS		30000	//GPRS attach and TCP connect
+#define TELEMETRY_WRITE_CHUNK			64		//Bytes per socket write, sent as hex
+#define TELEMETRY_MAGIC					0x54
+#define TELEMETRY_VERSION				1
 
 typedef struct _SMS
 {
@@ -28,6 +52,19 @@ typedef struct _SMS
 }TSMS;
 typedef TSMS * TSMSPtr;
 
+//Called while waiting for modem answers: keeps time critical work (relais pulse end) running
+typedef void (*TIdleCallback)();
+
+//Modem state changes, published by ModemGSM and consumed by the application. value: recovery stage (meModemReset).
+//Events are lost when the queue is full: what must not be missed is also read as state (Error(), IsPBReady(), IsRegisteredToNetwork())
+typedef enum _ModemEventType {meModemReady, meRegistered, meDeregistered, mePBReady, meSMSFailed, meModemReset} EModemEventType;
+
+typedef struct _ModemEvent
+{
+	byte type;
+	int value;
+}TModemEvent;
+
 template <int i> 
 class SMSIndexQueue
 {
@@ -35,8 +72,9 @@ public:
     SMSIndexQueue() {FCount = 0;};
 
     boolean Enqueue(int pIndex);    
+	boolean Insert(byte pPos, int pIndex);
     boolean Dequeue(int *pIndex);
-	boolean Peek(int *pIndex);
+	boolean Peek(int *pIndex, byte pPos = 0);
 
     inline byte Count() 
     {
@@ -74,77 +112,245 @@ protected:
 	void Dispose(byte pIndex);
 };
 
+template <int i> 
+class EventQueue
+{
+public:
+    EventQueue() {FCount = 0; FHead = 0;};
+
+    boolean Post(byte pType, int pValue);
+    boolean Get(TModemEvent *pEvent);
+
+    inline byte Count() 
+    { 
+        return FCount;
+    };
+    
+    void Clear(); 
+
+protected:
+    TModemEvent FEvents[i];
+    byte FHead;
+    byte FCount;
+};
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Deployment configuration, passed to ModemGSMBase as a template argument.
+//	Every value is a compile time constant: buffers and queues are sized exactly
+//	and disabled features are compiled out. A deployment defines its own struct 
+//	with the same members.
+////////////////////////////////////////////////////////////////////////////////////
+struct ModemConfig
+{
+	enum
+	{
+		RXBufferSize = 163,
+		SMSInQueueSize = 10,
+		SMSOutQueueSize = 10,
+		URCQueueSize = 10,
+		EventQueueSize = 8,
+		RegistrationDelayMS = 15000,		//Delay before assuming to be registered to network, 0 = none
+		TelemetryBufferSize = 0,			//GPRS telemetry store and forward buffer, 0 = no GPRS
+		TelemetryIntervalS = 1800			//Telemetry frames are sent together once per interval
+	};
+};
 
-class ModemGSM
+////////////////////////////////////////////////////////////////////////////////////
+//	GPRS telemetry: the application appends length prefixed frames, they are kept
+//	while the network is not available (the oldest are dropped when the buffer is
+//	full) and sent together over one TCP connection per interval:
+//
+//	batch	<TELEMETRY_MAGIC> <TELEMETRY_VERSION> <seq> <lost frames> <length lo> <length hi> <frames>
+//	frame	<length of type + payload> <type> <payload>
+//
+//	Multi byte values are little endian. tools/TelemetryReceiver.py receives and
+//	decodes the batches. The socket commands are the u-blox ones (AT+UPSD, AT+UPSDA,
+//	AT+UDCONF, AT+USOCR, AT+USOCO, AT+USOWR, AT+USOCL), data is written in hex mode:
+//	without MODEM_UBLOX (PinConfig.h) telemetry is compiled out, whatever the
+//	configured TelemetryBufferSize
+////////////////////////////////////////////////////////////////////////////////////
+#ifdef MODEM_UBLOX
+  #define TELEMETRY_SUPPORTED			1
+#else
+  #define TELEMETRY_SUPPORTED			0
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////
+//	TSerial is the modem port type (HardwareSerial, SoftwareSerial or anything 
+//	with the same begin/end/available/read/print/println members): calls are 
+//	resolved at compile time. Instances are explicitly instantiated in ModemGSM.cpp
+////////////////////////////////////////////////////////////////////////////////////
+template <class TSerial, class TConfig>
+class ModemGSMBase
 {
 	typedef enum _StandardAnswer {saTimeout, saOk, saError, saUnknown} EStandardAnswer;
+	//AT commands grouped by expected answer time, every class learns its own timeout
+	typedef enum _CommandClass {ccKeepAlive, ccPhonebook, ccSMSRead, ccSMSStore, ccSMSSend, ccClock, ccCount} ECommandClass;
+	typedef enum _StartupStage {ssPowerPulse, ssSettle, ssSerialSpeed, ssSpeedEcho, ssInitEcho, ssReady} EStartupStage;
+public:
+	//Telemetry buffer size, 0 if the modem has no socket commands
+	enum {TelemetrySize = TELEMETRY_SUPPORTED ? TConfig::TelemetryBufferSize : 0};
 protected:
     boolean FRegisteredToNetwork;
     byte FNetworkLedPin;
     byte FPowerOnPin;
 
-    char FRXBuff[RX_BUFFER_SIZE];     
+    char FRXBuff[TConfig::RXBufferSize];     
+	byte FStartupStage;
+	Timeout FStartupTS;
 
-    SMSIndexQueue <SMS_IN_QUEUE_MAX_ITEM_COUNT> FSMSInQueue;
-    SMSIndexQueue <SMS_OUT_QUEUE_MAX_ITEM_COUNT> FSMSOutQueue;
-    URCQueue <URC_QUEUE_MAX_ITEM_COUNT> FURCQueue; 
-    HardwareSerial *FSerial;
-    char FLastCommand[SMS_TEXT_BUFFER_SIZE];
+    SMSIndexQueue <TConfig::SMSInQueueSize> FSMSInQueue;
+    SMSIndexQueue <TConfig::SMSOutQueueSize> FSMSOutQueue;
+    URCQueue <TConfig::URCQueueSize> FURCQueue; 
+    EventQueue <TConfig::EventQueueSize> FEvents;
+    TSerial *FSerial;
+    FILE FCommandStream;
 	byte FSignalLevel;
+	byte FPrevSignalLevel;
+	byte FSendMinLevel;
+	byte FSendAttempts[6];				//SMS send attempts by signal level (0 = unknown)
+	byte FSendOK[6];					//Successful SMS sends by signal level (0 = unknown)
+	Timeout FSignalChangeTS;
+	boolean FSMSDeferActive;			//A deferrable SMS is queued, FSMSDeferTS started with the oldest one
+	Timeout FSMSDeferTS;
 	boolean FPBReady;
-#ifdef REGISTRATION_DELAYED
+	PhonebookIndex FPBIndex;
+	byte FPBCapacity;					//0 = not queried yet
+	int FPBNext;						//Next phonebook entry to index
+	boolean FPBIndexReady;
 	boolean FNetworkRegDelayActive;
     Timeout FNetworkRegDelayTS;    
-#endif
 	boolean FSMSResendPending;
 	byte FSMSRetry;
+	byte FReadSMSCount;					//Incoming SMS read but not deleted yet
 
     Timeout FLastKeepAliveTS;
+	unsigned long FKeepAliveIntervalMS;
     Timeout FLastBlinkTS;
 	Timeout FSMSResendTS;
 	boolean FError;
 	byte FKeepAliveFailedCount;
+	byte FLastRecoveryStage;
+	unsigned long FRecoveryStageMS[4];
+	LatencyEstimator FLatency[ccCount];
+	unsigned long FCommandTS;
+	Timeout FLatencySaveTS;
+	TIdleCallback FIdleCallback;
+	byte FTelemetry[TelemetrySize ? TelemetrySize : 1];
+	int FTelemetryLen;
+	byte FTelemetrySeq;
+	byte FTelemetryLost;
+	Timeout FTelemetryTS;
 
     boolean InnerSetup();
+	void Startup();
+	void NextStartupStage(byte pStage, unsigned int pTimeoutMS);
+	void ResetState(boolean pCold);
+	void RequestSerialSpeed();
+	void ApplySerialSpeed();
+	void SetupSerialSpeed();
+	boolean ApplyInitSequence(unsigned int pEchoDiscardMS);
+	boolean CommitInitSequence();
+	boolean QueryNetworkRegistration();
+	boolean QueryPBReady();
+	void FlushSerialInput();
+	boolean WaitReady(unsigned int pTimeoutMS);
     void DiscardSerialInput(unsigned int pTimeout);  
+    void IdleDelay(unsigned int pTimeout);
     void DiscardPrompt(unsigned int pTimeout);
 
+	EStandardAnswer ParseAnswer();
 	EStandardAnswer WaitAnswer(unsigned int pTimeoutMS, boolean pHandleURC=false);
+	EStandardAnswer WaitCommandDeadline(unsigned int pTimeoutMS, boolean pHandleURC=false);
+	EStandardAnswer WaitCommandAnswer(ECommandClass pClass, boolean pHandleURC=false);
+	unsigned int CommandTimeout(ECommandClass pClass);
+	void ResetPBIndex();
+	boolean QueryPBCapacity();
+	boolean IndexPBPage();
+	boolean CompletePBIndex();
+	boolean ScanPB(int pFirst, int pLast, const char *pNumber, int *pFound);
+	boolean WaitDataAnswer(int *pValue);
+	boolean TelemetryWrite(int pSocket, const byte *pData, int pLen);
+	boolean TelemetryFlush();
+	void PostEvent(byte pType, int pValue = 0);
+	void SetRegistered(boolean pRegistered);
+	void SignalError();
+	void LoadLatencyTable();
+	void SaveLatencyTable();
 	boolean HandleURC();
 
     int Readln(unsigned int pTimeout, boolean pIgnoreLeadingLF);    
     void SendCommand(const char *__fmt, ...);
+	void DrainInput();
 	void EvalNetworkLedStatus();
 	boolean WriteSMS(const char *pDestPhoneNumber, const char *pBody,int *pIndex);
 	boolean SendSMSAtIndex(int pIndex);
+	boolean SendGateOpen();
+	void UpdateDeferState();
+	void RecordSendResult(boolean pSuccess);
+	void TuneSendThreshold();
 	boolean SendKeepAlive();
+	boolean KeepAlive();
+	void AdaptKeepAlive(boolean pHealthy);
+	void NoteModemAlive();
 public:
 	typedef enum _Queue {qIn, qOut} EQueue;
+	typedef enum _RecoveryStage {rsNone, rsWarm, rsSerial, rsPowerCycle} ERecoveryStage;
+	//plError: the phonebook could not be read, the number may be there
+	typedef enum _PBLookup {plNotFound, plFound, plError} EPBLookup;
 
-    boolean Initialize(HardwareSerial *pSerial, byte pNetworkLedPin, byte pPowerOnPin);
+    void Initialize(TSerial *pSerial, byte pNetworkLedPin, byte pPowerOnPin);
+	boolean Recover();
     void PowerOn();
+	inline void SetIdleCallback(TIdleCallback pCallback) { FIdleCallback = pCallback; };
     int Dispatch();
+	inline boolean GetEvent(TModemEvent *pEvent) { return FEvents.Get(pEvent); };
 
-    boolean SendSMS(const char *pDestPhoneNumber, const char *pBody);
+    boolean SendSMS(const char *pDestPhoneNumber, const char *pBody, boolean pDeferrable = false);
 
     boolean SMSDequeue(EQueue pQueue, TSMSPtr pItem);    
     int SMSCount(EQueue pQueue);
 
 	boolean GetPBEntryByName(const char *pName,char *pNumber, int *pIndex);
-	boolean NumberExistsInPB(const char *pNumber, int *pIndex);
-	boolean RegisterNumberInPB(char *pName, char *pNumber);
+	EPBLookup LookupNumberInPB(const char *pNumber, int *pIndex);
+	boolean RegisterNumberInPB(const char *pName, const char *pNumber);
 	boolean DeletePBEntryAtIndex(byte pIndex);
 
+	boolean GetNetworkTime(byte *pDayOfWeek, byte *pHour, byte *pMinute);
+
+	boolean TelemetryAppend(byte pType, const byte *pPayload, byte pLen);
+	inline int TelemetryPending() { return FTelemetryLen; };
+
 	boolean ClearSMSMemory();
 	boolean ReadSMSAtIndex(int pIndex, TSMSPtr pSMS);
 	boolean DeleteSMSAtIndex(int pIndex);
+	boolean DeleteReadSMS();
 
 	inline boolean Error() { return FError;};
 	inline boolean IsPBReady() { return FPBReady;};
+	inline boolean IsPBIndexReady() { return FPBIndexReady;};
+	inline byte PBCapacity() { return FPBCapacity;};
 	inline boolean IsRegisteredToNetwork() {return FRegisteredToNetwork; };	
 	inline boolean IsSMSAvailable() {return FSMSInQueue.Count() != 0; };
+	inline byte SignalLevel() {return FSignalLevel; };
+	inline byte SendMinLevel() {return FSendMinLevel; };
+	inline byte SendAttempts(byte pLevel) {return FSendAttempts[pLevel]; };
+	inline byte SendSuccesses(byte pLevel) {return FSendOK[pLevel]; };
+	inline ERecoveryStage LastRecoveryStage() {return (ERecoveryStage)FLastRecoveryStage; };
+	inline unsigned long RecoveryStageTime(ERecoveryStage pStage) {return FRecoveryStageMS[pStage]; };
 };
 
+//The modem port, FakeModemSerial for bench tests without a modem (FAKE_MODEM in PinConfig.h)
+#ifdef FAKE_MODEM
+  #define MODEM_SERIAL_CLASS	FakeModemSerial
+  #define MODEM_SERIAL_PORT		FakeModem
+#else
+  #define MODEM_SERIAL_CLASS	HardwareSerial
+  #define MODEM_SERIAL_PORT		Serial
+#endif
+
+typedef ModemGSMBase<MODEM_SERIAL_CLASS, ModemConfig> ModemGSM;
+
 #define UNKNOWN_LEVEL	99
 #endif
 
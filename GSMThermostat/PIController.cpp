@@ -0,0 +1,124 @@
+#include <SoftwareSerial.h>
+
+#include "PIController.h"
+#include "SerialDebug.h"
+#include "Utils.h"
+
+void PIController::Initialize(boolean pRelayOn, double pTemperature)
+{
+	FHeatRate = PI_DEFAULT_HEAT_RATE;
+	FCoolRate = PI_DEFAULT_COOL_RATE;
+
+	FSegmentTS.Set(PI_RATE_MAX_SEGMENT_MS);
+	FSwitchTS.Set(PI_MIN_ON_MS);
+	FSwitchTS.SetElapsed(PI_MIN_ON_MS);
+	FCycleTS.Set(PI_CYCLE_MS);
+
+	Reset(pRelayOn, pTemperature);
+}
+
+//The relais may have been switched outside the controller (OFF command): a new rate
+//segment starts from its current state, the time in that state is not restarted
+void PIController::Reset(boolean pRelayOn, double pTemperature)
+{
+	FRelayOn = pRelayOn;
+	FSegmentTemp = pTemperature;
+	FSegmentTS.Reset();
+
+	//Start a new cycle at the next Dispatch
+	FIntegral = 0;
+	FDuty = 0;
+	FOnTimeMS = 0;
+	FCycleStarted = false;
+}
+
+void PIController::CloseSegment(double pTemperature)
+{
+	unsigned long duration = FSegmentTS.Elapsed();
+
+	if(duration >= PI_RATE_MIN_SEGMENT_MS)
+	{
+		double slope = (pTemperature - FSegmentTemp) * 3600000.0 / duration;
+
+		//Moving averages, alpha = 1/4. Net rise with heater on = heat - cool
+		if(FRelayOn)
+			FHeatRate += ((slope + FCoolRate) - FHeatRate) / 4;
+		else if(slope < 0)
+			FCoolRate += (-slope - FCoolRate) / 4;
+
+		if(FHeatRate < 0.1)
+			FHeatRate = 0.1;
+	}
+
+	FSegmentTemp = pTemperature;
+	FSegmentTS.Reset();
+}
+
+void PIController::StartCycle(double pTemperature, double pSetpoint)
+{
+	double error = pSetpoint - pTemperature;
+	double feedForward = FCoolRate / (FHeatRate + FCoolRate);
+	double output;
+
+	output = feedForward + error / PI_PROPORTIONAL_BAND + FIntegral;
+
+	//Anti-windup: integrate only if the output is not saturated in the direction of the error
+	if(((output < 1) || (error < 0)) && ((output > 0) || (error > 0)))
+	{
+		FIntegral += error * (PI_CYCLE_MS / 60000.0) / (PI_PROPORTIONAL_BAND * PI_INTEGRAL_TIME_MIN);
+
+		if(FIntegral > 1)
+			FIntegral = 1;
+		else if(FIntegral < -1)
+			FIntegral = -1;
+
+		output = feedForward + error / PI_PROPORTIONAL_BAND + FIntegral;
+	}
+
+	if(output > 1)
+		output = 1;
+	else if(output < 0)
+		output = 0;
+
+	FDuty = output;
+	FOnTimeMS = (unsigned long)(output * PI_CYCLE_MS);
+
+	//Too short pulses only wear the relais
+	if(FOnTimeMS < PI_MIN_ON_MS)
+		FOnTimeMS = 0;
+	else if((PI_CYCLE_MS - FOnTimeMS) < PI_MIN_OFF_MS)
+		FOnTimeMS = PI_CYCLE_MS;
+
+	FCycleTS.Reset();
+	FCycleStarted = true;
+
+	DEBUG_P(PSTR("PI Duty --> %d%% (I %d%%, heat %d, cool %d cC/h)"LB), (int)(FDuty * 100), (int)(FIntegral * 100), 
+		(int)(FHeatRate * 100), (int)(FCoolRate * 100));
+}
+
+//Returns the expected relais state
+boolean PIController::Dispatch(double pTemperature, double pSetpoint, boolean pRelayOn)
+{
+	boolean res;
+
+	//Rates are estimated on the relais segments
+	if((pRelayOn != FRelayOn) || FSegmentTS.IsExpired())
+	{
+		if(pRelayOn != FRelayOn)
+			FSwitchTS.Reset();
+
+		CloseSegment(pTemperature);
+		FRelayOn = pRelayOn;
+	}
+
+	if(!FCycleStarted || FCycleTS.IsExpired())
+		StartCycle(pTemperature, pSetpoint);
+
+	res = FCycleTS.Elapsed() < FOnTimeMS;
+
+	//Minimum time in the current state
+	if((res != pRelayOn) && (FSwitchTS.Elapsed() < (pRelayOn ? PI_MIN_ON_MS : PI_MIN_OFF_MS)))
+		res = pRelayOn;
+
+	return res;
+}
@@ -0,0 +1,61 @@
+#ifndef __PI_CONTROLLER
+#define __PI_CONTROLLER
+#include "WProgram.h"
+#include "Timeout.h"
+
+#define PI_CYCLE_MS						((unsigned long)1000*60*20)	//Time proportioning cycle
+#define PI_MIN_ON_MS					((unsigned long)1000*60*3)	//Minimum relais ON time
+#define PI_MIN_OFF_MS					((unsigned long)1000*60*3)	//Minimum relais OFF time
+#define PI_PROPORTIONAL_BAND			1.0			//Error (C) giving 100% duty from the P term
+#define PI_INTEGRAL_TIME_MIN			60.0		//Integral time (minutes)
+#define PI_RATE_MIN_SEGMENT_MS			((unsigned long)1000*60*10)	//Shortest ON/OFF segment used to estimate rates
+#define PI_RATE_MAX_SEGMENT_MS			((unsigned long)1000*60*60)	//Longer segments are split
+#define PI_DEFAULT_HEAT_RATE			2.0			//C/h gained with the heater on (before losses)
+#define PI_DEFAULT_COOL_RATE			0.5			//C/h lost with the heater off
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Time proportioning PI controller
+//
+//	Every PI_CYCLE_MS the duty cycle is computed as:
+//
+//	duty = feed forward + error / PI_PROPORTIONAL_BAND + integral
+//
+//	The feed forward is the duty that balances the losses, cool / (heat + cool),
+//	from the heating and cooling rates learned on the relais ON/OFF segments.
+//	The integral is not updated while the output is saturated in the direction
+//	of the error (anti-windup). ON and OFF times shorter than the minimum ones
+//	are rounded to 0 or to the whole cycle, and the relais never switches
+//	before the minimum time in the current state has elapsed.
+//
+//	tools/host/ControlBench compares it with the hysteresis control on the
+//	simulated room: overshoot, settling time and relais cycles per day.
+////////////////////////////////////////////////////////////////////////////////////
+class PIController
+{
+public:
+	void Initialize(boolean pRelayOn, double pTemperature);
+	void Reset(boolean pRelayOn, double pTemperature);
+	boolean Dispatch(double pTemperature, double pSetpoint, boolean pRelayOn);
+
+	inline double Duty() { return FDuty; };
+	inline double HeatingRate() { return FHeatRate; };
+	inline double CoolingRate() { return FCoolRate; };
+protected:
+	double FIntegral;
+	double FDuty;
+	double FHeatRate;
+	double FCoolRate;
+	unsigned long FOnTimeMS;
+	boolean FCycleStarted;
+	Timeout FCycleTS;
+
+	boolean FRelayOn;
+	Timeout FSegmentTS;
+	Timeout FSwitchTS;
+	double FSegmentTemp;
+
+	void StartCycle(double pTemperature, double pSetpoint);
+	void CloseSegment(double pTemperature);
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "PhonebookIndex.h"
+#include "Utils.h"
+#include <string.h>
+
+void PhonebookIndex::Clear()
+{
+	FCount = 0;
+	FOverflow = false;
+	memset(FUsed, 0, sizeof(FUsed));
+}
+
+boolean PhonebookIndex::Add(unsigned int pHash, byte pIndex)
+{
+	byte pos;
+
+	FUsed[pIndex >> 3] |= (1 << (pIndex & 0x07));
+
+	if(FCount == PB_INDEX_SIZE)
+	{
+		FOverflow = true;
+		return false;
+	}
+
+	for(pos = FCount; (pos > 0) && (FEntries[pos - 1].hash > pHash); pos--);
+
+	memmove(&FEntries[pos + 1], &FEntries[pos], (FCount - pos) * sizeof(TEntry));
+	FEntries[pos].hash = pHash;
+	FEntries[pos].index = pIndex;
+	FCount++;
+
+	return true;
+}
+
+void PhonebookIndex::Remove(byte pIndex)
+{
+	FUsed[pIndex >> 3] &= ~(1 << (pIndex & 0x07));
+
+	for(byte pos = 0; pos < FCount; pos++)
+		if(FEntries[pos].index == pIndex)
+		{
+			FCount--;
+			memmove(&FEntries[pos], &FEntries[pos + 1], (FCount - pos) * sizeof(TEntry));
+			return;
+		}
+}
+
+int PhonebookIndex::Find(unsigned int pHash)
+{
+	byte low = 0;
+	byte high = FCount;
+
+	//Lower bound: the first entry not below pHash
+	for(;low < high;)
+	{
+		byte mid = (low + high) / 2;
+
+		if(FEntries[mid].hash < pHash)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return ((low < FCount) && (FEntries[low].hash == pHash)) ? low : -1;
+}
+
+byte PhonebookIndex::FirstFree(byte pCapacity)
+{
+	for(int i = 1; i <= pCapacity; i++)
+		if(!(FUsed[i >> 3] & (1 << (i & 0x07))))
+			return i;
+
+	return 0;
+}
+
+void PhonebookIndex::Normalize(const char *pNumber, char *pNormalized, byte pSize)
+{
+	byte len = 0;
+
+	//International prefix as "+", then the country code if the number has none
+	if(*pNumber == '+')
+		pNumber++;
+	else if((pNumber[0] == '0') && (pNumber[1] == '0'))
+		pNumber += 2;
+	else
+		for(const char *cc = PB_COUNTRY_CODE; *cc && (len < (pSize - 2)); cc++)
+			pNormalized[++len] = *cc;
+
+	pNormalized[0] = '+';
+
+	//Digits only: spaces, dashes and dots are dropped
+	for(;*pNumber && (len < (pSize - 2)); pNumber++)
+		if((*pNumber >= '0') && (*pNumber <= '9'))
+			pNormalized[++len] = *pNumber;
+
+	pNormalized[len + 1] = '\0';
+}
+
+unsigned int PhonebookIndex::Hash(const char *pNormalized)
+{
+	unsigned long hash = HashString(pNormalized);
+
+	return (unsigned int)(hash ^ (hash >> 16));
+}
@@ -0,0 +1,48 @@
+#ifndef __PHONEBOOK_INDEX
+#define __PHONEBOOK_INDEX
+
+#include "WProgram.h"
+
+#define PB_INDEX_SIZE				48			//Numbers kept in the sorted index
+#define PB_MAX_ENTRIES				256			//Phonebook positions tracked by the used map
+#define PB_COUNTRY_CODE				"39"		//Prefix of the numbers written without international prefix
+
+////////////////////////////////////////////////////////////////////////////////////
+//	In RAM index of the SIM phonebook: 16 bit hash of the normalized number and
+//	phonebook position, sorted by hash so a lookup is a binary search. A hash 
+//	match is only a candidate, the caller confirms it on the SIM entry. 
+//	A map of the used positions gives the first free one without a SIM scan.
+//	If the SIM holds more numbers than the index the overflow flag is set and
+//	the caller falls back to a SIM scan.
+////////////////////////////////////////////////////////////////////////////////////
+class PhonebookIndex
+{
+public:
+	void Clear();
+	boolean Add(unsigned int pHash, byte pIndex);
+	void Remove(byte pIndex);
+	int Find(unsigned int pHash);				//First position with pHash, -1 if none
+	byte FirstFree(byte pCapacity);				//0 if the phonebook is full
+
+	inline byte Count() { return FCount; };
+	inline unsigned int HashAt(byte pPos) { return FEntries[pPos].hash; };
+	inline byte IndexAt(byte pPos) { return FEntries[pPos].index; };
+	inline boolean IsOverflow() { return FOverflow; };
+
+	//+39 333 1234567, 00393331234567 and 3331234567 --> +393331234567
+	static void Normalize(const char *pNumber, char *pNormalized, byte pSize);
+	static unsigned int Hash(const char *pNormalized);
+protected:
+	typedef struct _Entry
+	{
+		unsigned int hash;
+		byte index;
+	}TEntry;
+
+	TEntry FEntries[PB_INDEX_SIZE];
+	byte FCount;
+	boolean FOverflow;
+	byte FUsed[PB_MAX_ENTRIES / 8];
+};
+
+#endif
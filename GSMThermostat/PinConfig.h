@@ -5,18 +5,31 @@
 //Do not change: hardwired into Libellium Shield
 #define PIN_MODEM_POWER        2
 #define PIN_MODEM_LED_NETWORK  13
+//Uncomment if the modem is a u-blox module: its AT socket commands carry the GPRS telemetry
+//#define MODEM_UBLOX
+//Uncomment to run the modem code against FakeModemSerial (scripted AT dialogue, no modem or SIM)
+//#define FAKE_MODEM
 
 //SerialDebug
 #define PIN_DEBUG_SERIAL_RX    9
 #define PIN_DEBUG_SERIAL_TX    8
 
 //TempSensor
+//TEMP_SENSOR_CLASS: TempSensorAD22100 (analog input), TempSensorDS18B20 (1-Wire, one probe per pin)
+//or TempSensorSim (simulated room, for bench tests)
+#define TEMP_SENSOR_CLASS      TempSensorAD22100
 #define PIN_TEMP_SENSOR        A0
 
 //LatchedRelais
 #define PIN_RELAIS_SET         4
 #define PIN_RELAIS_RESET       3
 
+//Zones: one temperature sensor and one latched relais each, listed in zone order
+#define ZONE_COUNT             1
+#define PIN_ZONE_TEMP_SENSORS  {PIN_TEMP_SENSOR}
+#define PIN_ZONE_RELAIS_SETS   {PIN_RELAIS_SET}
+#define PIN_ZONE_RELAIS_RESETS {PIN_RELAIS_RESET}
+
 //
 #define PIN_LED_ACTIVE         10
 #define PIN_LED_RELAIS_SET     11
@@ -0,0 +1,85 @@
+#include <SoftwareSerial.h>
+#include "Profile.h"
+
+#ifdef PROFILE
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "Utils.h"
+#include "SerialDebug.h"
+
+static volatile unsigned int ProfileOverflows;
+static unsigned long ProfileOverhead;
+static TProfileStat ProfileStats[ppCount];
+
+static const char ProfileNames[ppCount][12] PROGMEM = {"Sensor", "Modem", "HandleSMS", "Thermostat"};
+
+ISR(TIMER1_OVF_vect)
+{
+	ProfileOverflows++;
+}
+
+void ProfileInitialize()
+{
+	unsigned long start;
+
+	//Normal mode, no prescaler: one tick per CPU cycle
+	TCCR1A = 0;
+	TCCR1B = _BV(CS10);
+	TCNT1 = 0;
+	TIMSK1 = _BV(TOIE1);
+
+	memset(ProfileStats, 0, sizeof(ProfileStats));
+
+	//Cost of an empty measurement
+	ProfileOverhead = 0;
+	start = ProfileCycles();
+	ProfileOverhead = ProfileCycles() - start;
+}
+
+unsigned long ProfileCycles()
+{
+	unsigned int low;
+	unsigned int high;
+	byte sreg = SREG;
+
+	cli();
+	low = TCNT1;
+	high = ProfileOverflows;
+
+	//Overflow not served yet, the counter has already wrapped
+	if((TIFR1 & _BV(TOV1)) && (low < 0x8000))
+		high++;
+
+	SREG = sreg;
+
+	return ((unsigned long)high << 16) | low;
+}
+
+void ProfileRecord(byte pProbe, unsigned long pStart)
+{
+	TProfileStat *stat = &ProfileStats[pProbe];
+	unsigned long cycles = ProfileCycles() - pStart - ProfileOverhead;
+
+	if((stat->count == 0) || (cycles < stat->min))
+		stat->min = cycles;
+
+	if(cycles > stat->max)
+		stat->max = cycles;
+
+	stat->last = cycles;
+
+	if(stat->count < 0xFFFF)
+		stat->count++;
+}
+
+void ProfileReport()
+{
+	for(byte i = 0; i < ppCount; i++)
+	{
+		TProfileStat *stat = &ProfileStats[i];
+
+		DEBUG_P(PSTR("Profile %S --> n %u min %lu max %lu last %lu cycles"LB), ProfileNames[i], stat->count, stat->min, stat->max, stat->last);
+	}
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef __PROFILE
+#define __PROFILE
+#include "WProgram.h"
+
+//-------------------------------- Config Begin
+
+//Uncomment to measure the hot paths in CPU cycles. Takes Timer1 over: no PWM on pins 9 and 10
+//#define PROFILE
+
+//-------------------------------- Config End
+
+////////////////////////////////////////////////////////////////////////////////////
+//	On target cycle counter: Timer1 runs at the CPU clock and its overflows 
+//	extend it to 32 bit. Every probe keeps count, min, max and last cycles of
+//	the code in a PROFILE_SCOPE, the cost of the measurement itself excluded.
+//	Without PROFILE the macros are empty.
+////////////////////////////////////////////////////////////////////////////////////
+
+typedef enum _ProfileProbe {ppSensor, ppModemDispatch, ppHandleSMS, ppThermostatLoop, ppCount} EProfileProbe;
+
+#ifdef PROFILE
+  typedef struct _ProfileStat
+  {
+	unsigned int count;
+	unsigned long min;
+	unsigned long max;
+	unsigned long last;
+  }TProfileStat;
+
+  extern void ProfileInitialize();
+  extern unsigned long ProfileCycles();
+  extern void ProfileRecord(byte pProbe, unsigned long pStart);
+  extern void ProfileReport();
+
+  class ProfileScope
+  {
+  public:
+	ProfileScope(byte pProbe) { FProbe = pProbe; FStart = ProfileCycles(); };
+	~ProfileScope() { ProfileRecord(FProbe, FStart); };
+  private:
+	byte FProbe;
+	unsigned long FStart;
+  };
+
+  #define PROFILE_INITIALIZE()		ProfileInitialize()
+  #define PROFILE_SCOPE(probe)		ProfileScope __profileScope(probe)
+  #define PROFILE_REPORT()			ProfileReport()
+#else
+  #define PROFILE_INITIALIZE()
+  #define PROFILE_SCOPE(probe)
+  #define PROFILE_REPORT()
+#endif
+
+#endif
@@ -0,0 +1,110 @@
+#include "ReplyWriter.h"
+
+ReplyWriter::ReplyWriter(char *pBuffer, int pSize)
+{
+	FBuffer = pBuffer;
+	FSize = pSize;
+	FLength = 0;
+	FTruncated = false;
+
+	if(pSize > 0)
+		pBuffer[0] = '\0';
+}
+
+ReplyWriter &ReplyWriter::Char(char pChar)
+{
+	if(FLength < (FSize - 1))
+	{
+		FBuffer[FLength++] = pChar;
+		FBuffer[FLength] = '\0';
+	}
+	else
+		FTruncated = true;
+
+	return *this;
+}
+
+void ReplyWriter::Truncate(int pLength)
+{
+	if(pLength < FLength)
+	{
+		FLength = pLength;
+		FBuffer[FLength] = '\0';
+		FTruncated = false;
+	}
+}
+
+ReplyWriter &ReplyWriter::Str(const char *pStr)
+{
+	for(;*pStr; pStr++)
+		Char(*pStr);
+
+	return *this;
+}
+
+ReplyWriter &ReplyWriter::Str_P(PGM_P pStr)
+{
+	char c;
+
+	for(;(c = pgm_read_byte(pStr)); pStr++)
+		Char(c);
+
+	return *this;
+}
+
+ReplyWriter &ReplyWriter::Int(long pValue)
+{
+	char digits[10];
+	byte count = 0;
+	unsigned long value = pValue;
+
+	if(pValue < 0)
+	{
+		Char('-');
+		value = -pValue;
+	}
+
+	//Least significant digit first
+	do
+	{
+		digits[count++] = '0' + (value % 10);
+		value /= 10;
+	}
+	while(value);
+
+	for(;count;)
+		Char(digits[--count]);
+
+	return *this;
+}
+
+ReplyWriter &ReplyWriter::Int2(byte pValue)
+{
+	Char('0' + (pValue / 10) % 10);
+	return Char('0' + pValue % 10);
+}
+
+ReplyWriter &ReplyWriter::Tenths(int pTenths)
+{
+	if(pTenths < 0)
+	{
+		Char('-');
+		pTenths = -pTenths;
+	}
+
+	Int(pTenths / 10);
+	Char('.');
+	return Char('0' + pTenths % 10);
+}
+
+ReplyWriter &ReplyWriter::Temp(double pCelsius)
+{
+	return Tenths((int)(pCelsius * 10 + ((pCelsius < 0) ? -0.5 : 0.5)));
+}
+
+ReplyWriter &ReplyWriter::Quoted(const char *pStr)
+{
+	Char('"');
+	Str(pStr);
+	return Char('"');
+}
@@ -0,0 +1,34 @@
+#ifndef __REPLY_WRITER
+#define __REPLY_WRITER
+#include "WProgram.h"
+#include <avr/pgmspace.h>
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Append only text builder on a caller buffer, no printf and no float library:
+//	the text is always terminated and is truncated when the buffer is full.
+////////////////////////////////////////////////////////////////////////////////////
+class ReplyWriter
+{
+public:
+	ReplyWriter(char *pBuffer, int pSize);
+
+	ReplyWriter &Str(const char *pStr);
+	ReplyWriter &Str_P(PGM_P pStr);
+	ReplyWriter &Char(char pChar);
+	ReplyWriter &Int(long pValue);
+	ReplyWriter &Int2(byte pValue);				//Two digits, zero padded
+	ReplyWriter &Tenths(int pTenths);			//Fixed point, one decimal
+	ReplyWriter &Temp(double pCelsius);			//Rounded to one decimal
+	ReplyWriter &Quoted(const char *pStr);		//"<pStr>"
+
+	inline int Length() { return FLength; };
+	void Truncate(int pLength);
+	inline boolean Truncated() { return FTruncated; };
+protected:
+	char *FBuffer;
+	int FSize;
+	int FLength;
+	boolean FTruncated;
+};
+
+#endif
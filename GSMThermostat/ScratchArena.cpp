@@ -0,0 +1,25 @@
+#include <SoftwareSerial.h>
+#include "ScratchArena.h"
+#include "Utils.h"
+#include "SerialDebug.h"
+
+ScratchArena Scratch;
+
+char *ScratchArena::Alloc(unsigned int pSize)
+{
+	char *res;
+
+	if(pSize > (SCRATCH_ARENA_SIZE - FTop))
+	{
+		DEBUG_P(PSTR("** Scratch Arena Full --> %u"LB), pSize);
+		return NULL;
+	}
+
+	res = FBuffer + FTop;
+	FTop += pSize;
+
+	if(FTop > FHighWater)
+		FHighWater = FTop;
+
+	return res;
+}
@@ -0,0 +1,42 @@
+#ifndef __SCRATCH_ARENA
+#define __SCRATCH_ARENA
+#include "WProgram.h"
+
+//Deepest chain: the SMS dequeued in loop() (TSMS) + the combined answer in HandleSMS()
+#define SCRATCH_ARENA_SIZE			350
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Statically allocated stack of scratch buffers. Alloc() takes from the top,
+//	Release() gives back everything allocated after a Mark(). ScratchScope does
+//	both: the buffers allocated through it live until the end of the block.
+////////////////////////////////////////////////////////////////////////////////////
+class ScratchArena
+{
+public:
+	char *Alloc(unsigned int pSize);
+
+	inline unsigned int Mark() { return FTop; };
+	inline void Release(unsigned int pMark) { FTop = pMark; };
+
+	inline unsigned int Used() { return FTop; };
+	inline unsigned int HighWater() { return FHighWater; };
+protected:
+	char FBuffer[SCRATCH_ARENA_SIZE];
+	unsigned int FTop;
+	unsigned int FHighWater;
+};
+
+extern ScratchArena Scratch;
+
+class ScratchScope
+{
+public:
+	ScratchScope() { FMark = Scratch.Mark(); };
+	~ScratchScope() { Scratch.Release(FMark); };
+
+	inline char *Alloc(unsigned int pSize) { return Scratch.Alloc(pSize); };
+private:
+	unsigned int FMark;
+};
+
+#endif
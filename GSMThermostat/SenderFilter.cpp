@@ -0,0 +1,84 @@
+#include "SenderFilter.h"
+#include "Utils.h"
+#include <string.h>
+
+void SenderFilter::Clear()
+{
+	FCount = 0;
+}
+
+//Moves the sender to the front of the table, a new sender takes the place of the least recently seen one
+SenderFilter::TEntry *SenderFilter::Touch(unsigned long pHash)
+{
+	TEntry entry;
+	byte i;
+
+	for(i = 0; (i < FCount) && (FEntries[i].hash != pHash); i++);
+
+	if(i < FCount)
+		entry = FEntries[i];
+	else
+	{
+		if(FCount < SENDER_FILTER_SIZE)
+			FCount++;
+
+		i = FCount - 1;
+
+		entry.hash = pHash;
+		entry.refillTS = millis();
+		entry.tokens = SENDER_BUCKET_SIZE;
+		entry.rejected = false;
+	}
+
+	memmove(&FEntries[1], &FEntries[0], i * sizeof(TEntry));
+	FEntries[0] = entry;
+
+	return &FEntries[0];
+}
+
+SenderFilter::EVerdict SenderFilter::Check(const char *pNumber)
+{
+	TEntry *entry = Touch(HashString(pNumber));
+	unsigned long elapsed = SafeSub(millis(), entry->refillTS);
+
+	//Refill, the time left over is kept for the next token
+	if(elapsed >= SENDER_REFILL_MS)
+	{
+		unsigned long tokens = elapsed / SENDER_REFILL_MS;
+
+		if(tokens >= (SENDER_BUCKET_SIZE - entry->tokens))
+		{
+			entry->tokens = SENDER_BUCKET_SIZE;
+			entry->refillTS = millis();
+		}
+		else
+		{
+			entry->tokens += tokens;
+			entry->refillTS += tokens * SENDER_REFILL_MS;
+		}
+	}
+
+	if(entry->tokens == 0)
+		return svLimited;
+
+	entry->tokens--;
+
+	if(entry->rejected && (SafeSub(millis(), entry->rejectTS) < SENDER_REJECT_TTL_MS))
+		return svRejected;
+
+	entry->rejected = false;
+	return svUnknown;
+}
+
+void SenderFilter::Reject(const char *pNumber)
+{
+	TEntry *entry = Touch(HashString(pNumber));
+
+	entry->rejected = true;
+	entry->rejectTS = millis();
+}
+
+void SenderFilter::Forget(const char *pNumber)
+{
+	Touch(HashString(pNumber))->rejected = false;
+}
@@ -0,0 +1,42 @@
+#ifndef __SENDER_FILTER
+#define __SENDER_FILTER
+
+#include "WProgram.h"
+
+#define SENDER_FILTER_SIZE			6			//Senders remembered, the least recently seen is dropped
+#define SENDER_REJECT_TTL_MS		((unsigned long)1000*60*60)	//A rejected number skips the phonebook for this time
+#define SENDER_BUCKET_SIZE			4			//SMS burst accepted from a number
+#define SENDER_REFILL_MS			((unsigned long)1000*60*2)	//One more SMS accepted every 2 minutes
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Front gate for incoming SMS: a token bucket per sender limits the rate of the
+//	commands, and numbers not found in the phonebook are remembered for a while
+//	so a flood does not scan the phonebook every time. Numbers are kept as a 32 
+//	bit hash in a small LRU table.
+////////////////////////////////////////////////////////////////////////////////////
+class SenderFilter
+{
+public:
+	typedef enum _Verdict {svUnknown, svRejected, svLimited} EVerdict;
+
+	void Clear();
+	EVerdict Check(const char *pNumber);		//Takes a token from the sender bucket
+	void Reject(const char *pNumber);			//Number not in the phonebook
+	void Forget(const char *pNumber);			//Number registered: look it up again
+protected:
+	typedef struct _Entry
+	{
+		unsigned long hash;
+		unsigned long refillTS;
+		unsigned long rejectTS;
+		byte tokens;
+		boolean rejected;
+	}TEntry;
+
+	TEntry FEntries[SENDER_FILTER_SIZE];		//Most recently seen first
+	byte FCount;
+
+	TEntry *Touch(unsigned long pHash);
+};
+
+#endif
@@ -5,6 +5,16 @@
 
 SoftwareSerial DebugSerial = SoftwareSerial(PIN_DEBUG_SERIAL_RX, PIN_DEBUG_SERIAL_TX);
 
+#ifdef MODEM_DEBUG
+static FILE DebugStream;
+
+static int DebugPutChar(char c, FILE *pStream)
+{
+    DebugSerial.print(c);
+    return 0;
+}
+#endif
+
 void DebugSerialInitialize()  
 {
     pinMode(PIN_DEBUG_SERIAL_RX, INPUT);
@@ -12,6 +22,10 @@ void DebugSerialInitialize()
     
     //9600 è il massimo per la Seriale via Software
     DebugSerial.begin(9600);
+
+#ifdef MODEM_DEBUG
+    fdev_setup_stream(&DebugStream, DebugPutChar, NULL, _FDEV_SETUP_WRITE);
+#endif
 }
 
 #ifdef MODEM_DEBUG
@@ -32,13 +46,11 @@ void Debug_P(PGM_P pStr, boolean pLN)
 
  void DEBUG_P(PGM_P __fmt, ...)
  {
- 	char buffer[161];
 	va_list arglist;
 	
+	//Formatted straight to the serial port: no buffer on the stack
 	va_start( arglist, __fmt );
-    vsprintf_P(buffer, __fmt, arglist );
+    vfprintf_P(&DebugStream, __fmt, arglist );
     va_end( arglist );	
-
-	DebugSerial.print(buffer);
  }
 #endif
\ No newline at end of file
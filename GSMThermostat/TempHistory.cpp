@@ -0,0 +1,228 @@
+#include <limits.h>
+#include <SoftwareSerial.h>
+
+#include "TempHistory.h"
+#include "SerialDebug.h"
+#include "Utils.h"
+
+#define NIBBLE_RELAY		0x7
+#define NIBBLE_WIDE			0x8
+#define MIN_SHORT_DELTA		-7
+#define MAX_SHORT_DELTA		6
+
+void TempHistory::Initialize(boolean pRelayOn)
+{
+	FFirstBlock = 0;
+	FBlockCount = 0;
+	FCurrentPeriod = 0;
+
+	for(byte i = 0; i < HISTORY_PERIOD_COUNT; i++)
+		ClearPeriod(i);
+
+	FRelayOn = pRelayOn;
+	FRelayTS = millis();
+
+	FSampleTS.Set(HISTORY_SAMPLE_INTERVAL_MS);
+	FPeriodTS.Set(HISTORY_PERIOD_MS);
+}
+
+void TempHistory::ClearPeriod(byte pIndex)
+{
+	FPeriods[pIndex].min = INT_MAX;
+	FPeriods[pIndex].max = INT_MIN;
+	FPeriods[pIndex].sum = 0;
+	FPeriods[pIndex].count = 0;
+	FPeriods[pIndex].onSeconds = 0;
+}
+
+void TempHistory::AddOnTime()
+{
+	unsigned long seconds = SafeSub(millis(), FRelayTS) / 1000;
+
+	//Keep the ms remainder for the next time
+	FRelayTS += seconds * 1000;
+
+	if(FRelayOn)
+		FPeriods[FCurrentPeriod].onSeconds += seconds;
+}
+
+void TempHistory::Dispatch(double pTemperature, boolean pRelayOn)
+{
+	if(pRelayOn != FRelayOn)
+	{
+		byte nibble = NIBBLE_RELAY;
+
+		AddOnTime();
+		FRelayOn = pRelayOn;
+
+		if(FBlockCount && !AppendNibbles(&nibble, 1))
+			NewBlock(FLastSample);
+	}
+
+	if(FPeriodTS.IsExpired())
+	{
+		FPeriodTS.Reset();
+		AddOnTime();
+
+		FCurrentPeriod = (FCurrentPeriod + 1) % HISTORY_PERIOD_COUNT;
+		ClearPeriod(FCurrentPeriod);
+	}
+
+	if(FSampleTS.IsExpired() || !FBlockCount)
+	{
+		FSampleTS.Reset();
+		Sample((int)(pTemperature * 10 + (pTemperature < 0 ? -0.5 : 0.5)));
+	}
+}
+
+void TempHistory::Sample(int pTemperature)
+{
+	TPeriod *period = &FPeriods[FCurrentPeriod];
+	int delta = pTemperature - FLastSample;
+	byte nibbles[3];
+
+	//Incremental summary
+	if(pTemperature < period->min)
+		period->min = pTemperature;
+	if(pTemperature > period->max)
+		period->max = pTemperature;
+	period->sum += pTemperature;
+	period->count++;
+
+	if(!FBlockCount)
+		NewBlock(pTemperature);
+	else if((delta >= MIN_SHORT_DELTA) && (delta <= MAX_SHORT_DELTA))
+	{
+		nibbles[0] = delta & 0x0F;
+		if(!AppendNibbles(nibbles, 1))
+			NewBlock(pTemperature);
+	}
+	else if((delta >= -128) && (delta <= 127))
+	{
+		nibbles[0] = NIBBLE_WIDE;
+		nibbles[1] = (delta >> 4) & 0x0F;
+		nibbles[2] = delta & 0x0F;
+		if(!AppendNibbles(nibbles, 3))
+			NewBlock(pTemperature);
+	}
+	else
+		NewBlock(pTemperature);
+
+	FLastSample = pTemperature;
+}
+
+void TempHistory::NewBlock(int pTemperature)
+{
+	TBlock *block;
+
+	//Ring full: drop the oldest block
+	if(FBlockCount == HISTORY_BLOCK_COUNT)
+	{
+		FFirstBlock = (FFirstBlock + 1) % HISTORY_BLOCK_COUNT;
+		FBlockCount--;
+	}
+
+	block = &FBlocks[(FFirstBlock + FBlockCount) % HISTORY_BLOCK_COUNT];
+	FBlockCount++;
+
+	block->base = pTemperature;
+	block->used = 0;
+	block->relay = FRelayOn;
+	FLastSample = pTemperature;
+}
+
+boolean TempHistory::AppendNibbles(const byte *pNibbles, byte pCount)
+{
+	TBlock *block = &FBlocks[(FFirstBlock + FBlockCount - 1) % HISTORY_BLOCK_COUNT];
+
+	if((block->used + pCount) > (HISTORY_BLOCK_DATA_SIZE * 2))
+		return false;
+
+	for(byte i = 0; i < pCount; i++, block->used++)
+	{
+		byte *b = &block->data[block->used >> 1];
+
+		if(block->used & 1)
+			*b = (*b & 0xF0) | pNibbles[i];
+		else
+			*b = (*b & 0x0F) | (pNibbles[i] << 4);
+	}
+
+	return true;
+}
+
+byte TempHistory::GetNibble(TBlock *pBlock, byte pPos)
+{
+	byte b = pBlock->data[pPos >> 1];
+
+	return (pPos & 1) ? (b & 0x0F) : (b >> 4);
+}
+
+boolean TempHistory::GetPeriod(byte pAge, int *pMin, int *pMax, int *pAvg, byte *pDuty)
+{
+	TPeriod *period;
+	unsigned long seconds;
+
+	if(pAge >= HISTORY_PERIOD_COUNT)
+		return false;
+
+	period = &FPeriods[(FCurrentPeriod + HISTORY_PERIOD_COUNT - pAge) % HISTORY_PERIOD_COUNT];
+
+	if(period->count == 0)
+		return false;
+
+	if(pAge == 0)
+	{
+		AddOnTime();
+		seconds = FPeriodTS.Elapsed() / 1000;
+	}
+	else
+		seconds = HISTORY_PERIOD_MS / 1000;
+
+	*pMin = period->min;
+	*pMax = period->max;
+	*pAvg = (int)(period->sum / (long)period->count);
+	*pDuty = seconds ? (byte)(((unsigned long)period->onSeconds * 100) / seconds) : 0;
+
+	if(*pDuty > 100)
+		*pDuty = 100;
+
+	return true;
+}
+
+void TempHistory::Dump()
+{
+	DEBUG_P(PSTR("History --> %d blocks"LB), (int)FBlockCount);
+
+	for(byte i = 0; i < FBlockCount; i++)
+	{
+		TBlock *block = &FBlocks[(FFirstBlock + i) % HISTORY_BLOCK_COUNT];
+		int value = block->base;
+		boolean relay = block->relay;
+
+		DEBUG_P(PSTR("%d%s"), value, (relay ? "*" : ""));
+
+		for(byte pos = 0; pos < block->used; pos++)
+		{
+			byte nibble = GetNibble(block, pos);
+
+			if(nibble == NIBBLE_RELAY)
+			{
+				relay = !relay;
+				continue;
+			}
+
+			if(nibble == NIBBLE_WIDE)
+			{
+				value += (signed char)((GetNibble(block, pos + 1) << 4) | GetNibble(block, pos + 2));
+				pos += 2;
+			}
+			else
+				value += (nibble & 0x08) ? (int)nibble - 16 : (int)nibble;
+
+			DEBUG_P(PSTR(" %d%s"), value, (relay ? "*" : ""));
+		}
+
+		DEBUG_P(PSTR(LB));
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef __TEMP_HISTORY
+#define __TEMP_HISTORY
+#include "WProgram.h"
+#include "Timeout.h"
+
+#define HISTORY_SAMPLE_INTERVAL_MS		((unsigned long)1000*60*15)
+#define HISTORY_BLOCK_COUNT				8			//8 blocks x 26 samples x 15 min --> about 2 days
+#define HISTORY_BLOCK_DATA_SIZE			13			//Bytes of nibbles per block
+#define HISTORY_PERIOD_MS				((unsigned long)1000*60*60*6)
+#define HISTORY_PERIOD_COUNT			4			//Current period + 3 completed ones
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Temperature history
+//
+//	Samples (tenths of degree) are kept in a ring of blocks. Every block starts
+//	with an absolute sample, then one nibble per sample holds the delta from
+//	the previous one:
+//
+//	0x0..0x6, 0x9..0xF	delta -7..+6 tenths
+//	0x7					relay toggled (no sample)
+//	0x8					next 2 nibbles hold a delta of -128..127 tenths
+//
+//	A larger delta starts a new block, when the ring is full the oldest block
+//	is dropped. Min/max/avg and relay duty cycle of the last periods are updated
+//	on every sample, so reading them never scans the samples.
+////////////////////////////////////////////////////////////////////////////////////
+class TempHistory
+{
+public:
+	void Initialize(boolean pRelayOn);
+	void Dispatch(double pTemperature, boolean pRelayOn);
+
+	boolean GetPeriod(byte pAge, int *pMin, int *pMax, int *pAvg, byte *pDuty);
+	void Dump();
+protected:
+	typedef struct _Block
+	{
+		int base;									//First sample
+		byte used : 7;								//Nibbles used
+		byte relay : 1;								//Relay state at the first sample
+		byte data[HISTORY_BLOCK_DATA_SIZE];
+	}TBlock;
+
+	typedef struct _Period
+	{
+		int min;
+		int max;
+		long sum;
+		unsigned int count;
+		unsigned int onSeconds;						//Relay on time
+	}TPeriod;
+
+	TBlock FBlocks[HISTORY_BLOCK_COUNT];
+	byte FFirstBlock;
+	byte FBlockCount;
+	int FLastSample;
+
+	TPeriod FPeriods[HISTORY_PERIOD_COUNT];
+	byte FCurrentPeriod;
+
+	boolean FRelayOn;
+	unsigned long FRelayTS;
+
+	Timeout FSampleTS;
+	Timeout FPeriodTS;
+
+	void Sample(int pTemperature);
+	void NewBlock(int pTemperature);
+	boolean AppendNibbles(const byte *pNibbles, byte pCount);
+	void AddOnTime();
+	void ClearPeriod(byte pIndex);
+	byte GetNibble(TBlock *pBlock, byte pPos);
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef __TEMP_SENSOR_ARRAY
+#define __TEMP_SENSOR_ARRAY
+#include "WProgram.h"
+
+#define TEMP_SENSOR_MAX_FAILURES    5           //Consecutive bad readings before a sensor is failed
+
+////////////////////////////////////////////////////////////////////////////////////
+//	One sensor per zone, all of the same type, read together without blocking.
+//	The sensor class is a template argument, so there are no virtual calls.
+//	A sensor class must provide:
+//
+//		void Initialize(byte pSensorPin);
+//		void StartConversion();						starts a reading and returns
+//		boolean IsConversionDone();
+//		boolean Collect(float *pTemperature);		false on a bad reading
+//		void Feedback(boolean pHeaterOn, float pTarget);	control state, used by the
+//													simulated sensor only
+//		boolean Scenario(char *pMode, float *pTarget);	scripted control mode ('H' or 'P')
+//													and target, simulated sensor only
+////////////////////////////////////////////////////////////////////////////////////
+template <class TSensor, byte NCount>
+class TempSensorArray
+{
+public:
+    void Initialize(const byte *pSensorPins)
+    {
+        for(byte i = 0; i < NCount; i++)
+        {
+            FSensors[i].Initialize(pSensorPins[i]);
+            FFailures[i] = 0;
+        }
+
+        FConverting = false;
+    }
+
+    //Starts the conversions, then collects them when all are done. 
+    //Returns true when pTemperatures has been updated, a bad reading keeps the previous value
+    boolean Dispatch(float *pTemperatures)
+    {
+        byte i;
+
+        if(!FConverting)
+        {
+            for(i = 0; i < NCount; i++)
+                FSensors[i].StartConversion();
+
+            FConverting = true;
+            return false;
+        }
+
+        for(i = 0; i < NCount; i++)
+        {
+            if(!FSensors[i].IsConversionDone())
+                return false;
+        }
+
+        for(i = 0; i < NCount; i++)
+        {
+            if(FSensors[i].Collect(&pTemperatures[i]))
+                FFailures[i] = 0;
+            else if(FFailures[i] < TEMP_SENSOR_MAX_FAILURES)
+                FFailures[i]++;
+        }
+
+        FConverting = false;
+        return true;
+    }
+
+    //Blocking reading, for the setup
+    void Read(float *pTemperatures)
+    {
+        for(;!Dispatch(pTemperatures););
+    }
+
+    //Heater state and target (0 if the zone is OFF) after every control sweep
+    inline void Feedback(byte pIndex, boolean pHeaterOn, float pTarget) { FSensors[pIndex].Feedback(pHeaterOn, pTarget); };
+
+    //True when the sensor scripts a new control mode and target for its zone
+    inline boolean Scenario(byte pIndex, char *pMode, float *pTarget) { return FSensors[pIndex].Scenario(pMode, pTarget); };
+
+    inline boolean IsFailed(byte pIndex) { return FFailures[pIndex] >= TEMP_SENSOR_MAX_FAILURES; };
+private:
+    TSensor FSensors[NCount];
+    byte FFailures[NCount];
+    boolean FConverting;
+};
+
+#endif
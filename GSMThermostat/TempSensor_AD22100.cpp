@@ -1,4 +1,5 @@
 #include "TempSensor_AD22100.h"
+#include "Utils.h"
 
 void TempSensorAD22100::Initialize(byte pSensorPin)
 {
@@ -13,23 +14,52 @@ int IntSort(const void * p1, const void *p2)
 
 double TempSensorAD22100::ReadTemperatureInCelsius()
 {
-    int values[NUM_SAMPLES];
-    byte i;
-    double sum;
-    
     //Wait for a while to avoid commutation noise
     delay(NOISE_DELAY_MS);
+
+    return Sample();
+}
+
+void TempSensorAD22100::StartConversion()
+{
+    FConversionTS = millis();
+}
+
+boolean TempSensorAD22100::IsConversionDone()
+{
+    //Wait for a while to avoid commutation noise, without blocking
+    return SafeSub(millis(), FConversionTS) >= NOISE_DELAY_MS;
+}
+
+boolean TempSensorAD22100::Collect(float *pTemperature)
+{
+    //The first conversion after a channel switch is an outlier discarded by the trimmed mean
+    *pTemperature = Sample();
+    return true;
+}
+
+double TempSensorAD22100::Sample()
+{
+    int values[NUM_SAMPLES];
     
     //Take X samples, discard the lower K and higher K the calculate the mean
-    for(i = 0; i < NUM_SAMPLES; i++)
+    for(byte i = 0; i < NUM_SAMPLES; i++)
         values[i] = analogRead(FSensorPin);
+
+    return CountsToCelsius(values);
+}
+
+double TempSensorAD22100::CountsToCelsius(int *pValues)
+{
+    byte i;
+    double sum;
         
     //Sort values so it's easier to discard fisrt K and last K
-    qsort(values, NUM_SAMPLES, sizeof(int), IntSort);
+    qsort(pValues, NUM_SAMPLES, sizeof(int), IntSort);
 
     //sum central values and calculate the mean
     for(i = NUM_SAMPLES_DISCARDED, sum = 0.0; i < (NUM_SAMPLES - NUM_SAMPLES_DISCARDED); i++)
-        sum += ((values[i] * (5.0 / 1024)) - 1.375) / 0.0225;
+        sum += ((pValues[i] * (5.0 / 1024)) - 1.375) / 0.0225;
     
     return  sum / (double) (NUM_SAMPLES - NUM_SAMPLES_DISCARDED * 2);
 }
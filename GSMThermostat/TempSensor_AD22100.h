@@ -7,9 +7,22 @@ class TempSensorAD22100
 public:
     void Initialize(byte pSensorPin);
     double ReadTemperatureInCelsius();
+
+    //Asynchronous reading, see TempSensor.h. The conversion is just the noise delay
+    void StartConversion();
+    boolean IsConversionDone();
+    boolean Collect(float *pTemperature);
+    inline void Feedback(boolean pHeaterOn, float pTarget) {};
+    inline boolean Scenario(char *pMode, float *pTarget) { return false; };
+
+    //Trimmed mean of NUM_SAMPLES ADC readings, sorted in place
+    static double CountsToCelsius(int *pValues);
     
 protected:
     byte FSensorPin;
+    unsigned long FConversionTS;
+
+    double Sample();
 };
 
 #define NUM_SAMPLES                20
@@ -0,0 +1,151 @@
+#include <SoftwareSerial.h>
+#include "TempSensor_DS18B20.h"
+#include "Utils.h"
+#include "SerialDebug.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//	The bus is driven low by switching the pin to OUTPUT (output latch LOW) and 
+//	released by switching it back to INPUT. Time slots run with interrupts off.
+////////////////////////////////////////////////////////////////////////////////////
+
+void TempSensorDS18B20::Initialize(byte pSensorPin)
+{
+    FSensorPin = pSensorPin;
+
+    //No internal pull-up, the bus has its own
+    pinMode(pSensorPin, INPUT);
+    digitalWrite(pSensorPin, LOW);
+
+    FPresent = false;
+}
+
+boolean TempSensorDS18B20::BusReset()
+{
+    boolean presence;
+
+    pinMode(FSensorPin, OUTPUT);
+    delayMicroseconds(480);
+
+    noInterrupts();
+    pinMode(FSensorPin, INPUT);
+    delayMicroseconds(70);
+    presence = (digitalRead(FSensorPin) == LOW);
+    interrupts();
+
+    delayMicroseconds(410);
+    return presence;
+}
+
+void TempSensorDS18B20::WriteBit(boolean pBit)
+{
+    noInterrupts();
+    pinMode(FSensorPin, OUTPUT);
+
+    if(pBit)
+    {
+        delayMicroseconds(5);
+        pinMode(FSensorPin, INPUT);
+        interrupts();
+        delayMicroseconds(60);
+    }
+    else
+    {
+        delayMicroseconds(60);
+        pinMode(FSensorPin, INPUT);
+        interrupts();
+        delayMicroseconds(5);
+    }
+}
+
+boolean TempSensorDS18B20::ReadBit()
+{
+    boolean res;
+
+    noInterrupts();
+    pinMode(FSensorPin, OUTPUT);
+    delayMicroseconds(3);
+    pinMode(FSensorPin, INPUT);
+    //Sample within 15 us from the falling edge
+    delayMicroseconds(8);
+    res = (digitalRead(FSensorPin) == HIGH);
+    interrupts();
+
+    delayMicroseconds(55);
+    return res;
+}
+
+void TempSensorDS18B20::WriteByte(byte pData)
+{
+    for(byte i = 0; i < 8; i++, pData >>= 1)
+        WriteBit(pData & 0x01);
+}
+
+byte TempSensorDS18B20::ReadByte()
+{
+    byte res = 0;
+
+    for(byte i = 0; i < 8; i++)
+    {
+        res >>= 1;
+
+        if(ReadBit())
+            res |= 0x80;
+    }
+
+    return res;
+}
+
+void TempSensorDS18B20::StartConversion()
+{
+    FConversionTS = millis();
+
+    //The result is collected when DS18B20_CONVERSION_MS is over
+    if(FPresent = BusReset())
+    {
+        WriteByte(DS18B20_SKIP_ROM);
+        WriteByte(DS18B20_CONVERT_T);
+    }
+}
+
+boolean TempSensorDS18B20::IsConversionDone()
+{
+    //A missing sensor does not hold the other zones
+    return !FPresent || (SafeSub(millis(), FConversionTS) >= DS18B20_CONVERSION_MS);
+}
+
+boolean TempSensorDS18B20::Collect(float *pTemperature)
+{
+    byte scratchpad[9];
+    byte crc = 0;
+    int raw;
+
+    if(!FPresent || !BusReset())
+    {
+        DEBUG_P(PSTR("** DS18B20 Not Present --> %d"LB), (int)FSensorPin);
+        return false;
+    }
+
+    WriteByte(DS18B20_SKIP_ROM);
+    WriteByte(DS18B20_READ_SCRATCHPAD);
+
+    for(byte i = 0; i < sizeof(scratchpad); i++)
+    {
+        scratchpad[i] = ReadByte();
+
+        if(i < (sizeof(scratchpad) - 1))
+            crc = Crc8Update(crc, scratchpad[i]);
+    }
+
+    raw = (int)(((unsigned int)scratchpad[1] << 8) | scratchpad[0]);
+
+    //A bus stuck low reads all zeros with a good CRC: the configuration register low bits are always 1
+    if((crc != scratchpad[sizeof(scratchpad) - 1]) || ((scratchpad[4] & 0x1F) != 0x1F) || (raw == DS18B20_POWER_ON_VALUE))
+    {
+        DEBUG_P(PSTR("** DS18B20 Bad Reading --> %d"LB), (int)FSensorPin);
+        return false;
+    }
+
+    //1/16 C per LSB
+    *pTemperature = raw / 16.0;
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef __TEMP_SENSOR_DS18B20
+#define __TEMP_SENSOR_DS18B20
+#include "WProgram.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Maxim DS18B20 1-Wire digital sensor, one externally powered probe per pin
+//	(4.7K pull-up, no parasitic power). The 750 ms conversion runs in the 
+//	sensor while the sketch goes on: see TempSensor.h
+////////////////////////////////////////////////////////////////////////////////////
+class TempSensorDS18B20
+{
+public:
+    void Initialize(byte pSensorPin);
+
+    void StartConversion();
+    boolean IsConversionDone();
+    boolean Collect(float *pTemperature);
+    inline void Feedback(boolean pHeaterOn, float pTarget) {};
+    inline boolean Scenario(char *pMode, float *pTarget) { return false; };
+    
+protected:
+    byte FSensorPin;
+    boolean FPresent;
+    unsigned long FConversionTS;
+
+    boolean BusReset();
+    void WriteBit(boolean pBit);
+    boolean ReadBit();
+    void WriteByte(byte pData);
+    byte ReadByte();
+};
+
+#define DS18B20_CONVERSION_MS      750         //12 bit resolution
+#define DS18B20_SKIP_ROM           0xCC
+#define DS18B20_CONVERT_T          0x44
+#define DS18B20_READ_SCRATCHPAD    0xBE
+#define DS18B20_POWER_ON_VALUE     0x0550      //85 C: no conversion has been done
+
+#endif
@@ -0,0 +1,267 @@
+#include <SoftwareSerial.h>
+#include <avr/pgmspace.h>
+#include "TempSensor_Sim.h"
+#include "TempSensor_AD22100.h"
+#include "Utils.h"
+#include "SerialDebug.h"
+
+typedef struct _SimRun
+{
+    byte scenario;
+    char mode;                                  //'H' hysteresis, 'P' PI, as the MODE command
+    byte target;                                //C
+    unsigned int minutes;
+}TSimRun;
+
+static const TSimRun SimRuns[] PROGMEM =
+{
+    {TempSensorSim::scColdStart, 'H', SIM_TARGET, SIM_COLD_START_MIN},
+    {TempSensorSim::scColdStart, 'P', SIM_TARGET, SIM_COLD_START_MIN},
+    {TempSensorSim::scDoorOpen, 'H', SIM_TARGET, SIM_DOOR_OPEN_RUN_MIN},
+    {TempSensorSim::scDoorOpen, 'P', SIM_TARGET, SIM_DOOR_OPEN_RUN_MIN},
+    {TempSensorSim::scSetpointChange, 'H', SIM_CHANGED_TARGET, SIM_SETPOINT_RUN_MIN},
+    {TempSensorSim::scSetpointChange, 'P', SIM_CHANGED_TARGET, SIM_SETPOINT_RUN_MIN}
+};
+
+#define SIM_RUN_COUNT   (sizeof(SimRuns) / sizeof(SimRuns[0]))
+
+void TempSensorSim::Initialize(byte pSensorPin)
+{
+    //Only names the reports, the room is not sampled
+    FPin = pSensorPin;
+    FHeaterOn = false;
+    FTarget = 0;
+    FModelTS = millis();
+    FElapsedS = 0;
+    FReportTS = millis();
+
+    if(SIM_SCENARIOS)
+    {
+        FRun = 0;
+        StartRun();
+    }
+    else
+    {
+        FRun = SIM_RUN_COUNT;
+        FRunS = 0;
+        FRunPending = false;
+        Settle(SIM_OUTSIDE_TEMP);
+        ClearMetrics();
+    }
+}
+
+void TempSensorSim::StartConversion()
+{
+    Step();
+}
+
+boolean TempSensorSim::IsConversionDone()
+{
+    return true;
+}
+
+boolean TempSensorSim::Collect(float *pTemperature)
+{
+    int values[NUM_SAMPLES];
+    //AD22100 at 5V: 1.375V + 22.5mV/C
+    float counts = (1.375 + 0.0225 * FRoom) * 1024 / 5.0;
+
+    for(byte i = 0; i < NUM_SAMPLES; i++)
+        values[i] = (int)(counts + 0.5) + random(-SIM_NOISE_COUNTS, SIM_NOISE_COUNTS + 1);
+
+    *pTemperature = TempSensorAD22100::CountsToCelsius(values);
+
+    if(SafeSub(millis(), FReportTS) >= SIM_REPORT_INTERVAL_MS)
+    {
+        FReportTS = millis();
+        Report(false);
+    }
+
+    return true;
+}
+
+void TempSensorSim::Feedback(boolean pHeaterOn, float pTarget)
+{
+    if(pHeaterOn && !FHeaterOn)
+        FCycles++;
+
+    FHeaterOn = pHeaterOn;
+
+    //A new target restarts the time to setpoint and the overshoot
+    if(pTarget != FTarget)
+    {
+        FTarget = pTarget;
+        FTargetS = FElapsedS;
+        FSettledS = FElapsedS;
+        FInBand = false;
+        FReachedS = -1;
+        FOvershoot = 0;
+        FErrorMeanSq = 0;
+        FErrorSamples = 0;
+    }
+}
+
+//Target and control mode of a new run, once
+boolean TempSensorSim::Scenario(char *pMode, float *pTarget)
+{
+    TSimRun run;
+
+    if(!FRunPending)
+        return false;
+
+    memcpy_P(&run, &SimRuns[FRun], sizeof(run));
+    *pMode = run.mode;
+    *pTarget = run.target;
+    FRunPending = false;
+
+    return true;
+}
+
+//Explicit Euler, one model second steps
+void TempSensorSim::Step()
+{
+    unsigned long seconds = SafeSub(millis(), FModelTS) / 1000;
+    TSimRun run;
+
+    FModelTS += seconds * 1000;
+
+    if(FRun < SIM_RUN_COUNT)
+        memcpy_P(&run, &SimRuns[FRun], sizeof(run));
+
+    for(;seconds; seconds--, FElapsedS++, FRunS++)
+    {
+        if((FRun < SIM_RUN_COUNT) && (FRunS >= (unsigned long)run.minutes * 60))
+        {
+            Report(true);
+
+            if(++FRun < SIM_RUN_COUNT)
+            {
+                StartRun();
+                memcpy_P(&run, &SimRuns[FRun], sizeof(run));
+            }
+            else
+                DEBUG_P(PSTR("Sim Pin %d --> Scenarios Done"LB), (int)FPin);
+        }
+
+        float losses = SIM_ROOM_W_PER_C * (FRoom - SIM_OUTSIDE_TEMP);
+        float heater = FHeaterOn ? SIM_HEATER_W : 0;
+        unsigned long minutes = FRunS / 60;
+
+        if((FRun < SIM_RUN_COUNT) && (run.scenario == scDoorOpen) && (minutes >= SIM_DOOR_OPEN_AT_MIN) && (minutes < (SIM_DOOR_OPEN_AT_MIN + SIM_DOOR_OPEN_MIN)))
+            losses *= SIM_DOOR_OPEN_FACTOR;
+
+        if(SIM_RADIATOR_J_PER_C > 0)
+        {
+            float transfer = SIM_RADIATOR_W_PER_C * (FRadiator - FRoom);
+
+            FRadiator += (heater - transfer) / SIM_RADIATOR_J_PER_C;
+            FRoom += (transfer - losses) / SIM_ROOM_J_PER_C;
+        }
+        else
+            FRoom += (heater - losses) / SIM_ROOM_J_PER_C;
+
+        if(FHeaterOn)
+        {
+            FEnergyJ += SIM_HEATER_W;
+            FEnergyWh += FEnergyJ / 3600;
+            FEnergyJ %= 3600;
+        }
+
+        if(FTarget <= 0)
+            continue;
+
+        //Settled from the first second after the last one outside the band
+        if(!(FInBand = (fabs(FRoom - FTarget) <= SIM_SETPOINT_BAND)))
+            FSettledS = FElapsedS + 1;
+
+        //Overshoot and RMS error are measured once the setpoint has been reached
+        if((FReachedS < 0) && (FRoom >= (FTarget - SIM_SETPOINT_BAND)))
+            FReachedS = FElapsedS - FTargetS;
+
+        if(FReachedS >= 0)
+        {
+            float error = FRoom - FTarget;
+
+            if(error > FOvershoot)
+                FOvershoot = error;
+
+            FErrorSamples++;
+            FErrorMeanSq += (error * error - FErrorMeanSq) / FErrorSamples;
+        }
+    }
+}
+
+//Every run of a scenario starts from the same room state
+void TempSensorSim::StartRun()
+{
+    TSimRun run;
+
+    memcpy_P(&run, &SimRuns[FRun], sizeof(run));
+    Settle(run.scenario == scColdStart ? SIM_OUTSIDE_TEMP : SIM_SETTLED_TEMP);
+
+    FRunS = 0;
+    FRunPending = true;
+    ClearMetrics();
+}
+
+//Room at pTemp, radiator at the temperature that holds it
+void TempSensorSim::Settle(float pTemp)
+{
+    FRoom = pTemp;
+    FRadiator = pTemp + SIM_ROOM_W_PER_C * (pTemp - SIM_OUTSIDE_TEMP) / SIM_RADIATOR_W_PER_C;
+}
+
+void TempSensorSim::ClearMetrics()
+{
+    FTargetS = FElapsedS;
+    FSettledS = FElapsedS;
+    FInBand = false;
+    FReachedS = -1;
+    FOvershoot = 0;
+    FErrorMeanSq = 0;
+    FErrorSamples = 0;
+    FCycles = 0;
+    FEnergyJ = 0;
+    FEnergyWh = 0;
+}
+
+void TempSensorSim::Report(boolean pRunEnd)
+{
+    char room[8];
+    char target[8];
+    char overshoot[8];
+    char rms[8];
+
+    dtostrf(FRoom, 1, 2, room);
+    dtostrf(FTarget, 1, 1, target);
+    dtostrf(FOvershoot, 1, 2, overshoot);
+    dtostrf(sqrt(FErrorMeanSq), 1, 2, rms);
+
+    if(pRunEnd)
+    {
+        TSimRun run;
+
+        memcpy_P(&run, &SimRuns[FRun], sizeof(run));
+        DEBUG_P(PSTR("Sim Pin %d Run %d "), (int)FPin, (int)FRun + 1);
+
+        switch(run.scenario)
+        {
+            case scColdStart:
+                DEBUG_P(PSTR("Cold Start"));
+                break;
+            case scDoorOpen:
+                DEBUG_P(PSTR("Door Open"));
+                break;
+            default:
+                DEBUG_P(PSTR("Setpoint Change"));
+        }
+
+        DEBUG_P(PSTR(" %s --> "), run.mode == 'P' ? "PI" : "Hysteresis");
+    }
+    else
+        DEBUG_P(PSTR("Sim Pin %d at %lu min --> "), (int)FPin, FElapsedS / 60);
+
+    DEBUG_P(PSTR("%s C Target %s C Reached %ld s Settled %ld s Overshoot %s RMS %s Cycles %u (%u/day) Energy %lu Wh"LB),
+        room, target, FReachedS, FInBand ? (long)(FSettledS - FTargetS) : -1L, overshoot, rms, FCycles, 
+        (unsigned int)(FRunS >= 60 ? (unsigned long)FCycles * 1440 / (FRunS / 60) : 0), FEnergyWh);
+}
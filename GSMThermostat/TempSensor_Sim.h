@@ -0,0 +1,94 @@
+#ifndef __TEMP_SENSOR_SIM
+#define __TEMP_SENSOR_SIM
+#include "WProgram.h"
+
+//-------------------------------- Scenario Begin
+
+#ifndef SIM_SCENARIOS
+#define SIM_SCENARIOS              1           //0: no scripted runs, the room starts cold and follows the sketch commands
+#endif
+#define SIM_OUTSIDE_TEMP           5.0         //C, also the cold start temperature
+#define SIM_SETTLED_TEMP           20.0        //C, room held here at the start of the door open and setpoint change runs
+#define SIM_HEATER_W               2000
+#define SIM_RADIATOR_J_PER_C       100000.0    //0: first order model, the heater warms the room air directly
+#define SIM_RADIATOR_W_PER_C       50.0        //Radiator to room
+#define SIM_ROOM_J_PER_C           1000000.0   //Air, walls and furniture
+#define SIM_ROOM_W_PER_C           40.0        //Room to outside
+#define SIM_TARGET                 20          //C, cold start and door open runs
+#define SIM_CHANGED_TARGET         22          //C, setpoint change run
+#define SIM_COLD_START_MIN         300         //Run lengths, model minutes
+#define SIM_DOOR_OPEN_RUN_MIN      180
+#define SIM_SETPOINT_RUN_MIN       180
+#define SIM_DOOR_OPEN_AT_MIN       30          //From the start of the door open run
+#define SIM_DOOR_OPEN_MIN          10
+#define SIM_DOOR_OPEN_FACTOR       8           //Losses multiplier while the door is open
+#define SIM_NOISE_COUNTS           3           //ADC noise, +/- counts
+#define SIM_SETPOINT_BAND          0.2         //Setpoint reached within this band
+#define SIM_REPORT_INTERVAL_MS     ((unsigned long)1000*60*10)
+
+//-------------------------------- Scenario End
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Simulated room for bench tests without a sensor: room air and radiator,
+//	heated by the zone relais. The temperature goes through the AD22100 chain
+//	(ADC counts with noise, trimmed mean), so the control loop sees what the
+//	real sensor would give. Select it as TEMP_SENSOR_CLASS.
+//
+//	The scenarios run in sequence, each once with the hysteresis and once with
+//	the PI control: cold start, door open, setpoint change. Every run starts
+//	from the same room state and hands its target and control mode to the
+//	sketch through Scenario(). The model runs on millis(), the clock of the
+//	control loop: in real time on the board, on the virtual clock of
+//	tools/host (ControlBench), where the whole suite takes seconds.
+//
+//	At the end of a run the control quality is reported on the debug serial,
+//	named by the sensor pin: time to setpoint, settling time (from the target
+//	change to the last exit from SIM_SETPOINT_BAND), overshoot, RMS error,
+//	relais cycles (total and per day) and energy. After the last run the room
+//	model goes on with the sketch commands
+////////////////////////////////////////////////////////////////////////////////////
+class TempSensorSim
+{
+public:
+    typedef enum _Scenario {scColdStart, scDoorOpen, scSetpointChange} EScenario;
+
+    void Initialize(byte pSensorPin);
+
+    void StartConversion();
+    boolean IsConversionDone();
+    boolean Collect(float *pTemperature);
+    void Feedback(boolean pHeaterOn, float pTarget);
+    boolean Scenario(char *pMode, float *pTarget);
+
+protected:
+    byte FPin;
+    float FRoom;
+    float FRadiator;
+    boolean FHeaterOn;
+    float FTarget;
+    unsigned long FModelTS;
+    unsigned long FElapsedS;                    //Model time
+
+    byte FRun;                                  //Scripted run, the run count once done
+    unsigned long FRunS;                        //Model time since the run start
+    boolean FRunPending;                        //Target and mode not taken by the sketch yet
+    unsigned long FTargetS;                     //Model time of the last target change
+    unsigned long FSettledS;                    //Model time the room entered the setpoint band for good, so far
+    boolean FInBand;                            //Room within SIM_SETPOINT_BAND now, else not settled
+    long FReachedS;                             //Time to setpoint, -1 not yet
+    float FOvershoot;
+    float FErrorMeanSq;                         //Running mean of the squared error
+    unsigned long FErrorSamples;
+    unsigned int FCycles;
+    unsigned int FEnergyJ;                      //Below one Wh
+    unsigned long FEnergyWh;
+    unsigned long FReportTS;
+
+    void Step();
+    void StartRun();
+    void Settle(float pTemp);
+    void ClearMetrics();
+    void Report(boolean pRunEnd);
+};
+
+#endif
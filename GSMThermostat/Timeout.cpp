@@ -17,3 +17,14 @@ boolean Timeout::IsExpired()
 {
 	return SafeSub(millis(), FTS) > FTimeout;
 }
+
+unsigned long Timeout::Elapsed()
+{
+	return SafeSub(millis(), FTS);
+}
+
+//Restart the timeout as if it had been started pElapsed ms ago
+void Timeout::SetElapsed(unsigned long pElapsed)
+{
+	FTS = millis() - pElapsed;
+}
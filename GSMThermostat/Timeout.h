@@ -9,6 +9,8 @@ public:
 	void Set(unsigned long pTimeout);
 	void Reset();
 	boolean IsExpired();
+	unsigned long Elapsed();
+	void SetElapsed(unsigned long pElapsed);
 protected:
 	unsigned long FTS;
 	unsigned long FTimeout;
@@ -16,3 +16,33 @@ void PulseOut(byte pPin, unsigned int pDelayMS)
     delay(pDelayMS);
     digitalWrite(pPin, LOW);
 }
+
+//Dallas/Maxim CRC-8 (x^8 + x^5 + x^4 + 1), one byte at a time
+byte Crc8Update(byte pCrc, byte pData)
+{
+    for(byte i = 0; i < 8; i++)
+    {
+        byte mix = (pCrc ^ pData) & 0x01;
+
+        pCrc >>= 1;
+        if(mix)
+            pCrc ^= 0x8C;
+        pData >>= 1;
+    }
+
+    return pCrc;
+}
+
+//FNV-1a, 32 bit
+unsigned long HashString(const char *pStr)
+{
+    unsigned long hash = 2166136261UL;
+
+    for(;*pStr; pStr++)
+    {
+        hash ^= (byte)*pStr;
+        hash *= 16777619UL;
+    }
+
+    return hash;
+}
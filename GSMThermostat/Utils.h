@@ -3,7 +3,34 @@
 
 #define LB	"\r\n"
 
+//-------------------------------- Config Begin
+
+//Uncomment to enable the AVR hardware watchdog (needs a bootloader that handles watchdog resets)
+//#define HW_WATCHDOG
+
+//-------------------------------- Config End
+
+//The watchdog is fed by loop() and by waits with a known bound, WATCHDOG_SLICE_MS at a time
+#define WATCHDOG_SLICE_MS		1000
+
+#ifdef HW_WATCHDOG
+  #include <avr/io.h>
+  #include <avr/wdt.h>
+  #define WATCHDOG_ENABLE()		wdt_enable(WDTO_8S)
+  //WDRF must be cleared first, it keeps the watchdog on after a watchdog reset
+  #define WATCHDOG_DISABLE()	do { MCUSR &= ~_BV(WDRF); wdt_disable(); } while(0)
+  #define WATCHDOG_RESET()		wdt_reset()
+  #define WATCHDOG_REBOOT()		for(;;)
+#else
+  #define WATCHDOG_ENABLE()
+  #define WATCHDOG_DISABLE()
+  #define WATCHDOG_RESET()
+  #define WATCHDOG_REBOOT()
+#endif
+
 extern unsigned long SafeSub(unsigned long p1, unsigned long p2);
 extern void PulseOut(byte pPin, unsigned int pDelayMS);
+extern byte Crc8Update(byte pCrc, byte pData);
+extern unsigned long HashString(const char *pStr);
 
 #endif
@@ -0,0 +1,198 @@
+#include <SoftwareSerial.h>
+#include <EEPROM.h>
+
+#include "WeekSchedule.h"
+#include "SerialDebug.h"
+#include "Utils.h"
+
+void WeekSchedule::Initialize(int pEEPROMAddress)
+{
+	FAddress = pEEPROMAddress;
+	FHasClock = false;
+	FSetpoint = 0;
+	FNextTransition = SCHED_NO_TRANSITION;
+	FChanged = false;
+
+	//Erased or corrupted table: start with an empty schedule
+	if(EEPROM.read(FAddress + SCHED_EEPROM_SIZE - 1) != Checksum())
+	{
+		DEBUG_P(PSTR("Schedule Not Valid --> Cleared"LB));
+
+		for(byte day = 0; day < SCHED_DAYS; day++)
+			ClearDay(day);
+	}
+}
+
+int WeekSchedule::IntervalAddress(byte pDay, byte pIndex)
+{
+	return FAddress + ((int)pDay * SCHED_MAX_INTERVALS + pIndex) * 3;
+}
+
+byte WeekSchedule::Checksum()
+{
+	byte crc = 0;
+
+	for(int i = 0; i < (SCHED_EEPROM_SIZE - 1); i++)
+		crc = Crc8Update(crc, EEPROM.read(FAddress + i));
+
+	return crc;
+}
+
+void WeekSchedule::UpdateChecksum()
+{
+	byte crc = Checksum();
+
+	if(EEPROM.read(FAddress + SCHED_EEPROM_SIZE - 1) != crc)
+		EEPROM.write(FAddress + SCHED_EEPROM_SIZE - 1, crc);
+}
+
+double WeekSchedule::SetpointToCelsius(byte pSetpoint)
+{
+	return SCHED_SETPOINT_BASE + (pSetpoint - 1) * 0.5;
+}
+
+byte WeekSchedule::CelsiusToSetpoint(double pCelsius)
+{
+	return (byte)((pCelsius - SCHED_SETPOINT_BASE) * 2 + 1.5);
+}
+
+void WeekSchedule::SetClock(byte pDay, byte pHour, byte pMinute)
+{
+	FSyncMinute = (unsigned int)pDay * MINUTES_PER_DAY + (unsigned int)pHour * 60 + pMinute;
+	FSyncTS = millis();
+	FHasClock = true;
+
+	DEBUG_P(PSTR("Schedule Clock --> day %d %02d:%02d"LB), (int)pDay, (int)pHour, (int)pMinute);
+
+	Evaluate();
+}
+
+unsigned int WeekSchedule::WeekMinute()
+{
+	return (unsigned int)((FSyncMinute + SafeSub(millis(), FSyncTS) / 60000) % MINUTES_PER_WEEK);
+}
+
+boolean WeekSchedule::AddInterval(byte pDay, byte pStartSlot, byte pEndSlot, byte pSetpoint)
+{
+	if((pDay >= SCHED_DAYS) || (pStartSlot >= pEndSlot) || (pEndSlot > SCHED_SLOTS_PER_DAY) || (pSetpoint == 0))
+		return false;
+
+	for(byte i = 0; i < SCHED_MAX_INTERVALS; i++)
+	{
+		int address = IntervalAddress(pDay, i);
+
+		//First free interval
+		if(EEPROM.read(address + 2) != 0)
+			continue;
+
+		EEPROM.write(address, pStartSlot);
+		EEPROM.write(address + 1, pEndSlot);
+		EEPROM.write(address + 2, pSetpoint);
+		UpdateChecksum();
+
+		Evaluate();
+		return true;
+	}
+
+	return false;
+}
+
+void WeekSchedule::ClearDay(byte pDay)
+{
+	for(byte i = 0; i < SCHED_MAX_INTERVALS; i++)
+	{
+		int address = IntervalAddress(pDay, i);
+
+		for(byte j = 0; j < 3; j++)
+			if(EEPROM.read(address + j) != 0)
+				EEPROM.write(address + j, 0);
+	}
+
+	UpdateChecksum();
+	Evaluate();
+}
+
+boolean WeekSchedule::GetInterval(byte pDay, byte pIndex, byte *pStartSlot, byte *pEndSlot, byte *pSetpoint)
+{
+	int address = IntervalAddress(pDay, pIndex);
+
+	if((pDay >= SCHED_DAYS) || (pIndex >= SCHED_MAX_INTERVALS) || ((*pSetpoint = EEPROM.read(address + 2)) == 0))
+		return false;
+
+	*pStartSlot = EEPROM.read(address);
+	*pEndSlot = EEPROM.read(address + 1);
+
+	return true;
+}
+
+void WeekSchedule::Evaluate()
+{
+	unsigned int now;
+	unsigned int next = SCHED_NO_TRANSITION;
+	byte setpoint = 0;
+
+	if(!FHasClock)
+		return;
+
+	now = WeekMinute();
+
+	for(byte day = 0; day < SCHED_DAYS; day++)
+	{
+		for(byte i = 0; i < SCHED_MAX_INTERVALS; i++)
+		{
+			byte startSlot;
+			byte endSlot;
+			byte code;
+			unsigned int boundary[2];
+
+			if(!GetInterval(day, i, &startSlot, &endSlot, &code))
+				continue;
+
+			boundary[0] = (unsigned int)day * MINUTES_PER_DAY + (unsigned int)startSlot * SCHED_SLOT_MINUTES;
+			boundary[1] = (unsigned int)day * MINUTES_PER_DAY + (unsigned int)endSlot * SCHED_SLOT_MINUTES;
+
+			//First interval containing now wins
+			if(!setpoint && (now >= boundary[0]) && (now < boundary[1]))
+				setpoint = code;
+
+			//Nearest boundary strictly after now, the week wraps around
+			for(byte j = 0; j < 2; j++)
+			{
+				unsigned int distance = (boundary[j] + MINUTES_PER_WEEK - now) % MINUTES_PER_WEEK;
+
+				if(distance && ((next == SCHED_NO_TRANSITION) || (distance < next)))
+					next = distance;
+			}
+		}
+	}
+
+	if(setpoint != FSetpoint)
+	{
+		FSetpoint = setpoint;
+		FChanged = true;
+	}
+
+	if(next == SCHED_NO_TRANSITION)
+		FNextTransition = SCHED_NO_TRANSITION;
+	else
+	{
+		FNextTransition = (now + next) % MINUTES_PER_WEEK;
+		FTransitionTS.Set((unsigned long)next * 60000 - (SafeSub(millis(), FSyncTS) % 60000));
+	}
+
+	DEBUG_P(PSTR("Schedule Setpoint --> %d next at %u"LB), (int)FSetpoint, FNextTransition);
+}
+
+//Returns true when the current setpoint changed since the last call
+boolean WeekSchedule::Dispatch()
+{
+	boolean res;
+
+	if(FHasClock && (FNextTransition != SCHED_NO_TRANSITION) && FTransitionTS.IsExpired())
+		Evaluate();
+
+	res = FChanged;
+	FChanged = false;
+
+	return res;
+}
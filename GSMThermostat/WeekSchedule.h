@@ -0,0 +1,67 @@
+#ifndef __WEEK_SCHEDULE
+#define __WEEK_SCHEDULE
+#include "WProgram.h"
+#include "Timeout.h"
+
+#define SCHED_DAYS						7			//Monday = 0
+#define SCHED_MAX_INTERVALS				3			//Intervals per day
+#define SCHED_SLOT_MINUTES				15			//Interval boundaries resolution
+#define SCHED_SLOTS_PER_DAY				(24 * 60 / SCHED_SLOT_MINUTES)
+#define SCHED_EEPROM_SIZE				(SCHED_DAYS * SCHED_MAX_INTERVALS * 3 + 1)
+#define SCHED_SETPOINT_BASE				5.0			//Setpoint code 1
+#define SCHED_NO_TRANSITION				0xFFFF
+#define MINUTES_PER_DAY					1440
+#define MINUTES_PER_WEEK				((unsigned int)MINUTES_PER_DAY * SCHED_DAYS)
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Weekly setpoint schedule
+//
+//	Every day holds up to SCHED_MAX_INTERVALS intervals, 3 bytes each, stored
+//	in EEPROM only:
+//
+//	<start slot><end slot><setpoint code>
+//
+//	Slots are SCHED_SLOT_MINUTES long (end slot excluded). The setpoint code is
+//	half degrees above SCHED_SETPOINT_BASE - 0.5, 0 marks an unused interval.
+//	The last byte is a checksum of the whole table.
+//
+//	The current setpoint and the time to the next interval boundary are
+//	computed only when a boundary is crossed, the clock is set or the table
+//	changes: Dispatch() is O(1) otherwise.
+////////////////////////////////////////////////////////////////////////////////////
+class WeekSchedule
+{
+public:
+	void Initialize(int pEEPROMAddress);
+
+	void SetClock(byte pDay, byte pHour, byte pMinute);
+	inline boolean HasClock() { return FHasClock; };
+	unsigned int WeekMinute();
+
+	boolean AddInterval(byte pDay, byte pStartSlot, byte pEndSlot, byte pSetpoint);
+	void ClearDay(byte pDay);
+	boolean GetInterval(byte pDay, byte pIndex, byte *pStartSlot, byte *pEndSlot, byte *pSetpoint);
+
+	boolean Dispatch();
+	inline byte CurrentSetpoint() { return FSetpoint; };
+	inline unsigned int NextTransition() { return FNextTransition; };
+
+	static double SetpointToCelsius(byte pSetpoint);
+	static byte CelsiusToSetpoint(double pCelsius);
+protected:
+	int FAddress;
+	boolean FHasClock;
+	unsigned int FSyncMinute;					//Week minute at the last clock set
+	unsigned long FSyncTS;						//millis() at the last clock set
+	byte FSetpoint;								//Current setpoint code, 0 = off
+	unsigned int FNextTransition;				//Week minute of the next boundary
+	boolean FChanged;
+	Timeout FTransitionTS;
+
+	int IntervalAddress(byte pDay, byte pIndex);
+	void Evaluate();
+	void UpdateChecksum();
+	byte Checksum();
+};
+
+#endif
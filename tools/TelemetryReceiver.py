@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""GSM Thermostat telemetry receiver.
+
+Listens for the GPRS telemetry batches sent by ModemGSM (one TCP connection
+per batch) and prints the decoded frames. The layout is documented in
+GSMThermostat/ModemGSM.h (batch and frame) and GSMThermostat/GSMThermostat.pde
+(status frame payload). Multi byte values are little endian.
+
+    TelemetryReceiver.py [port]          listen, default port 5000 (TELEMETRY_PORT)
+    TelemetryReceiver.py --hex <data>    decode one batch given as hex, eg the
+                                         AT+USOWR data from the debug log
+"""
+
+import socket
+import struct
+import sys
+
+TELEMETRY_MAGIC = 0x54
+TELEMETRY_VERSION = 1
+TELEMETRY_FRAME_STATUS = 1
+
+ZONE_STATUS_ACTIVE = 0x01
+ZONE_STATUS_RELAIS = 0x02
+ZONE_STATUS_FAILED = 0x04
+
+
+def decode_status(payload):
+    # <uptime s 4> <signal> <sms in> <sms out> <resets> <failed sends 2> then per zone <temp 2> <set 2> <flags>
+    if len(payload) < 10 or (len(payload) - 10) % 5:
+        return "status, bad length %d" % len(payload)
+
+    uptime, signal, sms_in, sms_out, resets, failed = struct.unpack_from("<IBBBBH", payload)
+    text = "status up %dh%02dm signal %d sms %d/%d resets %d failed sends %d" % (
+        uptime // 3600, uptime // 60 % 60, signal, sms_in, sms_out, resets, failed)
+
+    for z, pos in enumerate(range(10, len(payload), 5)):
+        temp, temp_set, flags = struct.unpack_from("<hhB", payload, pos)
+        text += "\n    zone %d temp %.1f set %.1f%s%s%s" % (
+            z + 1, temp / 10.0, temp_set / 10.0,
+            " ACTIVE" if flags & ZONE_STATUS_ACTIVE else "",
+            " RELAIS" if flags & ZONE_STATUS_RELAIS else "",
+            " FAILED" if flags & ZONE_STATUS_FAILED else "")
+
+    return text
+
+
+def decode_batch(data):
+    # <magic> <version> <seq> <lost frames> <length 2> <frames>, frame <length of type + payload> <type> <payload>
+    if len(data) < 6:
+        return ["short batch, %d bytes" % len(data)]
+
+    magic, version, seq, lost, length = struct.unpack_from("<BBBBH", data)
+    if magic != TELEMETRY_MAGIC or version != TELEMETRY_VERSION:
+        return ["bad header %02X %02X" % (magic, version)]
+
+    lines = ["batch seq %d lost %d, %d bytes" % (seq, lost, length)]
+    frames = data[6:6 + length]
+    if len(frames) < length:
+        lines.append("  truncated, %d bytes received" % len(frames))
+
+    pos = 0
+    while pos < len(frames):
+        size = frames[pos]
+        frame = frames[pos + 1:pos + 1 + size]
+        pos += 1 + size
+
+        if size == 0 or len(frame) < size:
+            lines.append("  bad frame at %d" % (pos - 1 - size))
+            break
+
+        if frame[0] == TELEMETRY_FRAME_STATUS:
+            lines.append("  " + decode_status(frame[1:]))
+        else:
+            lines.append("  type %d: %s" % (frame[0], frame[1:].hex()))
+
+    return lines
+
+
+def serve(port):
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(("", port))
+    server.listen(4)
+    print("Listening on port %d" % port)
+
+    while True:
+        conn, addr = server.accept()
+        conn.settimeout(60)
+        data = b""
+        try:
+            while True:
+                chunk = conn.recv(1024)
+                if not chunk:
+                    break
+                data += chunk
+        except socket.timeout:
+            pass
+        finally:
+            conn.close()
+
+        print("%s:" % addr[0])
+        for line in decode_batch(data):
+            print(line)
+
+
+def main():
+    if len(sys.argv) > 2 and sys.argv[1] == "--hex":
+        for line in decode_batch(bytes.fromhex("".join(sys.argv[2:]))):
+            print(line)
+    else:
+        serve(int(sys.argv[1]) if len(sys.argv) > 1 else 5000)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,84 @@
+////////////////////////////////////////////////////////////////////////////////////
+//	Control quality benchmark: the sketch on the virtual clock with the simulated
+//	room (TempSensorSim) runs the scripted scenarios, cold start, door open and
+//	setpoint change, each once with the hysteresis and once with the PI control.
+//	The run reports (time to setpoint, settling time, overshoot, RMS error,
+//	relais cycles per run and per day, energy) are printed as the sketch writes
+//	them on the debug port. The whole suite takes seconds.
+//
+//	ControlBench [-v] [-l <loop ms>] [-s <seed>]
+//
+//	-v		print all the debug output, not only the room model reports
+//	-l		idle time of a loop() pass, default 20 ms
+//	-s		seed of the sensor noise
+////////////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "HostInstance.h"
+
+#define BENCH_LIMIT_MS			((unsigned long)1000*60*60*48)	//The suite takes 22 h of model time
+#define BENCH_STEP_MS			((unsigned long)1000*60)
+
+typedef struct _Bench
+{
+	bool verbose;
+	bool done;
+}TBench;
+
+static void BenchLine(void *pContext, const char *pLine)
+{
+	TBench *bench = (TBench *)pContext;
+
+	if(bench->verbose || (strncmp(pLine, "Sim ", 4) == 0))
+		printf("%8.1f min  %s\n", HostNow() / 60000.0, pLine);
+
+	if(strstr(pLine, "Scenarios Done"))
+		bench->done = true;
+}
+
+int main(int argc, char *argv[])
+{
+	THostConfig config;
+	TBench bench;
+	clock_t start = clock();
+	int opt;
+
+	memset(&config, 0, sizeof(config));
+	memset(&bench, 0, sizeof(bench));
+	config.seed = 1;
+	config.loopMS = 20;
+	config.debugSink = BenchLine;
+	config.debugContext = &bench;
+
+	while((opt = getopt(argc, argv, "vl:s:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'v':
+				bench.verbose = true;
+				break;
+			case 'l':
+				config.loopMS = strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				config.seed = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-v] [-l <loop ms>] [-s <seed>]\n", argv[0]);
+				return 2;
+		}
+	}
+
+	HostStart(&config);
+
+	for(unsigned long t = BENCH_STEP_MS; !bench.done && (t <= BENCH_LIMIT_MS); t += BENCH_STEP_MS)
+		HostRun(t);
+
+	printf("%s in %.1f s\n", bench.done ? "Done" : "** Not done", (double)(clock() - start) / CLOCKS_PER_SEC);
+
+	return bench.done ? 0 : 1;
+}
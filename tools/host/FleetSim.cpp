@@ -0,0 +1,810 @@
+////////////////////////////////////////////////////////////////////////////////////
+//	Fleet simulation: many thermostats in one process, each a copy of the
+//	instance library (libThermostatInstance.so: the sketch, ModemGSM, the fake
+//	modem and the room model, on its own virtual clock). Every copy is loaded
+//	with its own globals, so the instances only share the worker threads.
+//
+//	Per instance a traffic generator sends the scripted SMS of FakeModemSerial
+//	at random times (Poisson, -r per day), from the owner and from a stranger,
+//	and the modem goes offline at random times (-o per week, -m minutes each).
+//	The instances run one day at a time, spread over the workers. At the end:
+//
+//	SMS		requests from the owner: answered, rejected by the network (SIM
+//			memory full), lost (no answer after FLEET_LOST_MS), pending at the
+//			end. Latency from the delivery to the read (AT+CMGR) and to the
+//			answer sent (AT+CMSS), percentiles over the fleet. An answer is
+//			matched when stored (AT+CMGW) to the last request read with the
+//			quoted command it starts with
+//	Control	sampled every minute while a zone is ON: RMS error and share of
+//			the time within FLEET_BAND of the setpoint, from the readings of
+//			the sketch, overall and once the setpoint has been reached (the
+//			warm up after ON left out); relais duty and cycles per day,
+//			longest coil pulse
+//	Modem	offline time, recoveries after a modem error, time given up
+//
+//	FleetSim [-n <instances>] [-j <workers>] [-d <days>] [-l <loop ms>]
+//	         [-c <millis() us>] [-r <SMS per day>] [-o <outages per week>]
+//	         [-m <outage min>] [-s <seed>] [-i] [-v <instance>] [-L <library>]
+//
+//	-c		virtual time of a millis() call, default 1000 us: the busy waits
+//			of the modem code poll ten times less than with ControlBench
+//	-i		one line per instance too
+//	-v		debug output of one instance
+////////////////////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "HostInstance.h"
+#include "PinConfig.h"
+
+#define FLEET_DAY_MS			((unsigned long)1000*60*60*24)
+#define FLEET_SAMPLE_MS			((unsigned long)1000*60)
+#define FLEET_LOST_MS			((unsigned long)1000*60*60)	//Requests unanswered for longer are lost
+#define FLEET_BAND				0.5							//C
+#define FLEET_MAX_WORKERS		64
+
+typedef struct _Request
+{
+	unsigned long deliveredMS;
+	std::string body;
+	bool owner;
+	bool read;
+	bool answered;
+}TRequest;
+
+typedef struct _Instance
+{
+	int id;
+	void *library;
+	const THostEntry *entry;
+	unsigned long long random;
+
+	unsigned long nextSMSMS;
+	unsigned long nextSampleMS;
+	unsigned long outageStartMS;
+	unsigned long outageEndMS;
+	bool offline;
+
+	//SMS
+	std::vector<TRequest> requests;
+	int incoming[HOST_SMS_SLOTS + 1];		//Request of an SMS memory slot, -1 none
+	int outgoing[HOST_SMS_SLOTS + 1];		//Request answered by a stored SMS, until sent, -1 none
+	std::deque<int> waiting;					//Owner requests not answered yet, in delivery order
+	std::vector<unsigned long> readLatency;
+	std::vector<unsigned long> answerLatency;
+	unsigned long rejected;
+	unsigned long notifications;				//Sent SMS that are not answers
+	unsigned long unmatched;					//Answers to no request read and waiting
+
+	//Control
+	unsigned long activeSamples;
+	unsigned long bandSamples;
+	unsigned long relaisSamples;
+	unsigned long samples;
+	double errorSq;
+	bool reached[HOST_MAX_ZONES];				//Setpoint reached since the zone was switched ON
+	float reachedSet[HOST_MAX_ZONES];
+	unsigned long steadySamples;				//After the setpoint has been reached
+	unsigned long steadyBandSamples;
+	double steadyErrorSq;
+	unsigned long cycles;
+	unsigned long coilOnMS[ZONE_COUNT][2];		//Set and reset coil, 0: off
+	unsigned long maxPulseMS;
+
+	//Modem
+	unsigned long outages;
+	unsigned long offlineMS;
+	unsigned long givenUpSamples;
+	unsigned long modemErrors;
+}TInstance;
+
+typedef struct _Fleet
+{
+	int count;
+	int workers;
+	int days;
+	unsigned long loopMS;
+	unsigned long callUS;
+	double smsPerDay;
+	double outagesPerWeek;
+	unsigned long outageMS;
+	unsigned long seed;
+	bool perInstance;
+	int verbose;
+	const char *library;
+
+	TInstance *instances;
+	std::vector<int> weights;					//Per scripted SMS
+	int totalWeight;
+	unsigned long untilMS;						//End of the running day
+	int next;									//Next instance to run
+	pthread_mutex_t lock;
+}TFleet;
+
+static TFleet Fleet;
+
+static const uint8_t RelaisSetPins[ZONE_COUNT] = PIN_ZONE_RELAIS_SETS;
+static const uint8_t RelaisResetPins[ZONE_COUNT] = PIN_ZONE_RELAIS_RESETS;
+
+static double WallSeconds()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Random numbers of an instance, independent from random() of the sketch
+////////////////////////////////////////////////////////////////////////////////////
+static double Uniform(TInstance *pInstance)
+{
+	pInstance->random = pInstance->random * 6364136223846793005ULL + 1442695040888963407ULL;
+	return ((pInstance->random >> 11) + 0.5) / 9007199254740992.0;
+}
+
+//Time to the next event of a Poisson process
+static unsigned long Exponential(TInstance *pInstance, double pMeanMS)
+{
+	return (unsigned long)(-log(Uniform(pInstance)) * pMeanMS) + 1;
+}
+
+static void ScheduleOutage(TInstance *pInstance, unsigned long pFromMS)
+{
+	if(Fleet.outagesPerWeek <= 0)
+	{
+		pInstance->outageStartMS = (unsigned long)-1;
+		return;
+	}
+
+	pInstance->outageStartMS = pFromMS + Exponential(pInstance, FLEET_DAY_MS * 7 / Fleet.outagesPerWeek);
+	pInstance->outageEndMS = pInstance->outageStartMS + Fleet.outageMS;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Hooks, called by the instance on the worker running it
+////////////////////////////////////////////////////////////////////////////////////
+static void InstanceDebug(void *pContext, const char *pLine)
+{
+	TInstance *instance = (TInstance *)pContext;
+
+	printf("[%d] %9.2f min  %s\n", instance->id, instance->entry->now() / 60000.0, pLine);
+}
+
+static void InstancePin(void *pContext, uint8_t pPin, uint8_t pValue)
+{
+	TInstance *instance = (TInstance *)pContext;
+	unsigned long now = instance->entry->now();
+
+	for(uint8_t z = 0; z < ZONE_COUNT; z++)
+	{
+		unsigned long *on;
+
+		if(pPin == RelaisSetPins[z])
+			on = &instance->coilOnMS[z][0];
+		else if(pPin == RelaisResetPins[z])
+			on = &instance->coilOnMS[z][1];
+		else
+			continue;
+
+		if(pValue)
+			*on = now + 1;
+		else if(*on)
+		{
+			instance->maxPulseMS = std::max(instance->maxPulseMS, now + 1 - *on);
+			*on = 0;
+
+			//A cycle is counted when the heater is switched on
+			if(pPin == RelaisSetPins[z])
+				instance->cycles++;
+		}
+	}
+}
+
+//"<command>" at the start of an answer, after the line break that ends AT+CMGW
+static bool QuotedCommand(const char *pText, std::string *pCommand)
+{
+	const char *end;
+
+	pText += strspn(pText, "\r\n");
+
+	if((*pText != '"') || !(end = strchr(pText + 1, '"')))
+		return false;
+
+	pCommand->assign(pText + 1, end - pText - 1);
+	return true;
+}
+
+static void InstanceModem(void *pContext, uint8_t pEvent, uint8_t pSlot, const char *pText)
+{
+	TInstance *instance = (TInstance *)pContext;
+	unsigned long now = instance->entry->now();
+	int r;
+
+	if(pSlot > HOST_SMS_SLOTS)
+		return;
+
+	switch(pEvent)
+	{
+		case hmeRead:
+			if((r = instance->incoming[pSlot]) >= 0)
+			{
+				instance->requests[r].read = true;
+				instance->readLatency.push_back(now - instance->requests[r].deliveredMS);
+				instance->incoming[pSlot] = -1;
+			}
+			break;
+		case hmeStored:
+		{
+			std::string command;
+			int i;
+
+			instance->outgoing[pSlot] = -1;
+
+			if(!QuotedCommand(pText, &command))
+			{
+				instance->notifications++;
+				break;
+			}
+
+			//The sketch answers the SMS it has just read
+			for(i = (int)instance->waiting.size() - 1; i >= 0; i--)
+				if(instance->requests[instance->waiting[i]].read && (instance->requests[instance->waiting[i]].body == command))
+					break;
+
+			if(i < 0)
+				instance->unmatched++;
+			else
+			{
+				instance->outgoing[pSlot] = instance->waiting[i];
+				instance->waiting.erase(instance->waiting.begin() + i);
+			}
+			break;
+		}
+		case hmeSent:
+			//A resend of the same slot is not counted again
+			if((r = instance->outgoing[pSlot]) >= 0)
+			{
+				instance->requests[r].answered = true;
+				instance->answerLatency.push_back(now - instance->requests[r].deliveredMS);
+				instance->outgoing[pSlot] = -1;
+			}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+//	One instance
+////////////////////////////////////////////////////////////////////////////////////
+static bool LoadInstance(TInstance *pInstance, const char *pPath)
+{
+	const THostEntry *(*entry)();
+
+	if(!(pInstance->library = dlopen(pPath, RTLD_NOW | RTLD_LOCAL)))
+	{
+		fprintf(stderr, "%s\n", dlerror());
+		return false;
+	}
+
+	if(!(entry = (const THostEntry *(*)())dlsym(pInstance->library, "HostEntry")))
+	{
+		fprintf(stderr, "%s\n", dlerror());
+		return false;
+	}
+
+	pInstance->entry = entry();
+	return true;
+}
+
+static void StartInstance(TInstance *pInstance)
+{
+	THostConfig config;
+
+	memset(&config, 0, sizeof(config));
+	config.seed = Fleet.seed + pInstance->id;
+	config.loopMS = Fleet.loopMS;
+	config.callUS = Fleet.callUS;
+	config.scriptedSMS = false;
+
+	if(pInstance->id == Fleet.verbose)
+	{
+		config.debugSink = InstanceDebug;
+		config.debugContext = pInstance;
+	}
+
+	pInstance->random = ((unsigned long long)Fleet.seed << 32) + pInstance->id * 2654435761UL + 1;
+
+	for(int i = 0; i <= HOST_SMS_SLOTS; i++)
+	{
+		pInstance->incoming[i] = -1;
+		pInstance->outgoing[i] = -1;
+	}
+
+	pInstance->entry->setPinHook(InstancePin, pInstance);
+	pInstance->entry->setModemHook(InstanceModem, pInstance);
+	pInstance->entry->start(&config);
+
+	pInstance->nextSMSMS = pInstance->entry->now() + Exponential(pInstance, FLEET_DAY_MS / Fleet.smsPerDay);
+	pInstance->nextSampleMS = pInstance->entry->now() + FLEET_SAMPLE_MS;
+	ScheduleOutage(pInstance, pInstance->entry->now());
+}
+
+static void DeliverSMS(TInstance *pInstance, unsigned long pNow)
+{
+	int pick = (int)(Uniform(pInstance) * Fleet.totalWeight);
+	char body[HOST_SMS_BODY_SIZE];
+	TRequest request;
+	uint8_t index;
+	uint8_t slot;
+
+	for(index = 0; pick >= Fleet.weights[index]; index++)
+		pick -= Fleet.weights[index];
+
+	request.owner = (pInstance->entry->smsScript(index, body) == HOST_SMS_OWNER);
+	request.body = body;
+	request.deliveredMS = pNow;
+	request.read = false;
+	request.answered = false;
+
+	if(!(slot = pInstance->entry->deliverSMS(index)))
+	{
+		pInstance->rejected++;
+		return;
+	}
+
+	pInstance->incoming[slot] = pInstance->requests.size();
+	if(request.owner)
+		pInstance->waiting.push_back(pInstance->requests.size());
+	pInstance->requests.push_back(request);
+}
+
+static void SampleInstance(TInstance *pInstance)
+{
+	THostSample sample;
+
+	pInstance->entry->sample(&sample);
+
+	for(uint8_t z = 0; z < sample.zoneCount; z++)
+	{
+		pInstance->samples++;
+
+		if(sample.zone[z].relais)
+			pInstance->relaisSamples++;
+
+		if(!sample.zone[z].active)
+		{
+			pInstance->reached[z] = false;
+			continue;
+		}
+
+		double error = sample.zone[z].temp - sample.zone[z].tempSet;
+		bool inBand = (fabs(error) <= FLEET_BAND);
+
+		pInstance->activeSamples++;
+		pInstance->errorSq += error * error;
+		if(inBand)
+			pInstance->bandSamples++;
+
+		//A new setpoint is a new warm up
+		if(pInstance->reached[z] && (pInstance->reachedSet[z] != sample.zone[z].tempSet))
+			pInstance->reached[z] = false;
+
+		if(!pInstance->reached[z] && inBand)
+		{
+			pInstance->reached[z] = true;
+			pInstance->reachedSet[z] = sample.zone[z].tempSet;
+		}
+
+		if(pInstance->reached[z])
+		{
+			pInstance->steadySamples++;
+			pInstance->steadyErrorSq += error * error;
+			if(inBand)
+				pInstance->steadyBandSamples++;
+		}
+	}
+
+	if(sample.modemGivenUp)
+		pInstance->givenUpSamples++;
+	pInstance->modemErrors = sample.modemErrors;
+}
+
+//Up to pUntilMS, stopping at every generator event
+static void RunInstance(TInstance *pInstance, unsigned long pUntilMS)
+{
+	unsigned long now;
+
+	while((now = pInstance->entry->now()) < pUntilMS)
+	{
+		unsigned long next = std::min(pUntilMS, std::min(pInstance->nextSMSMS, pInstance->nextSampleMS));
+
+		next = std::min(next, pInstance->offline ? pInstance->outageEndMS : pInstance->outageStartMS);
+
+		if(now < next)
+		{
+			pInstance->entry->run(next);
+			now = pInstance->entry->now();
+		}
+
+		if(!pInstance->offline && (now >= pInstance->outageStartMS))
+		{
+			pInstance->offline = true;
+			pInstance->outages++;
+			pInstance->entry->setModemOffline(true);
+		}
+		else if(pInstance->offline && (now >= pInstance->outageEndMS))
+		{
+			pInstance->offline = false;
+			pInstance->offlineMS += now - pInstance->outageStartMS;
+			pInstance->entry->setModemOffline(false);
+			ScheduleOutage(pInstance, now);
+		}
+
+		if(now >= pInstance->nextSMSMS)
+		{
+			DeliverSMS(pInstance, now);
+			pInstance->nextSMSMS = now + Exponential(pInstance, FLEET_DAY_MS / Fleet.smsPerDay);
+		}
+
+		if(now >= pInstance->nextSampleMS)
+		{
+			SampleInstance(pInstance);
+			pInstance->nextSampleMS += FLEET_SAMPLE_MS;
+		}
+	}
+}
+
+static void *Worker(void *pContext)
+{
+	for(;;)
+	{
+		int i;
+
+		pthread_mutex_lock(&Fleet.lock);
+		i = Fleet.next++;
+		pthread_mutex_unlock(&Fleet.lock);
+
+		if(i >= Fleet.count)
+			return NULL;
+
+		RunInstance(&Fleet.instances[i], Fleet.untilMS);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Setup and report
+////////////////////////////////////////////////////////////////////////////////////
+
+//Every instance gets its own copy of the library: dlopen() of the same file gives the same globals
+static bool LoadFleet()
+{
+	char dir[] = "/tmp/FleetSimXXXXXX";
+	std::vector<char> image;
+	std::vector<std::string> paths;
+	FILE *f;
+	bool res = true;
+	char buf[4096];
+	size_t len;
+
+	if(!(f = fopen(Fleet.library, "rb")))
+	{
+		perror(Fleet.library);
+		return false;
+	}
+
+	while((len = fread(buf, 1, sizeof(buf), f)) > 0)
+		image.insert(image.end(), buf, buf + len);
+	fclose(f);
+
+	if(!mkdtemp(dir))
+	{
+		perror(dir);
+		return false;
+	}
+
+	for(int i = 0; res && (i < Fleet.count); i++)
+	{
+		snprintf(buf, sizeof(buf), "%s/instance%04d.so", dir, i);
+		paths.push_back(buf);
+
+		if(!(f = fopen(buf, "wb")) || (fwrite(&image[0], 1, image.size(), f) != image.size()))
+			res = false;
+		if(f)
+			fclose(f);
+
+		res = res && LoadInstance(&Fleet.instances[i], buf);
+	}
+
+	//The loaded copies stay mapped
+	for(size_t i = 0; i < paths.size(); i++)
+		unlink(paths[i].c_str());
+	rmdir(dir);
+
+	return res;
+}
+
+static unsigned long Percentile(std::vector<unsigned long> &pValues, double pShare)
+{
+	if(pValues.empty())
+		return 0;
+
+	return pValues[std::min(pValues.size() - 1, (size_t)(pShare * pValues.size()))];
+}
+
+static void PrintLatency(const char *pName, std::vector<unsigned long> &pValues)
+{
+	std::sort(pValues.begin(), pValues.end());
+
+	printf("    %-16s p50 %7.2f s  p95 %7.2f s  p99 %7.2f s  max %8.2f s  (%lu)\n", pName,
+		Percentile(pValues, 0.50) / 1000.0, Percentile(pValues, 0.95) / 1000.0, Percentile(pValues, 0.99) / 1000.0,
+		pValues.empty() ? 0 : pValues.back() / 1000.0, (unsigned long)pValues.size());
+}
+
+static double Share(unsigned long pPart, unsigned long pTotal)
+{
+	return pTotal ? 100.0 * pPart / pTotal : 0;
+}
+
+static void Report(double pWallS)
+{
+	TInstance total;
+	unsigned long owner = 0;
+	unsigned long answered = 0;
+	unsigned long lost = 0;
+	unsigned long pending = 0;
+	unsigned long stranger = 0;
+	unsigned long modemErrors = 0;
+	unsigned long maxPulseMS = 0;
+	unsigned long endMS = Fleet.untilMS;
+
+	total.readLatency.clear();
+	total.answerLatency.clear();
+	total.rejected = total.notifications = total.unmatched = 0;
+	total.activeSamples = total.bandSamples = total.relaisSamples = total.samples = 0;
+	total.errorSq = 0;
+	total.steadySamples = total.steadyBandSamples = 0;
+	total.steadyErrorSq = 0;
+	total.cycles = 0;
+	total.outages = total.offlineMS = total.givenUpSamples = 0;
+
+	if(Fleet.perInstance)
+		printf("\n  #  requests answered  lost  rejected  answer p95  RMS C  band %%  cycles/day  recoveries  given up min\n");
+
+	for(int i = 0; i < Fleet.count; i++)
+	{
+		TInstance *instance = &Fleet.instances[i];
+		unsigned long instanceLost = 0;
+		unsigned long instanceOwner = 0;
+
+		for(size_t r = 0; r < instance->requests.size(); r++)
+		{
+			TRequest *request = &instance->requests[r];
+
+			if(!request->owner)
+				stranger++;
+			else
+			{
+				instanceOwner++;
+
+				if(request->answered)
+					answered++;
+				else if(endMS - request->deliveredMS > FLEET_LOST_MS)
+					instanceLost++;
+				else
+					pending++;
+			}
+		}
+
+		owner += instanceOwner;
+		lost += instanceLost;
+		total.rejected += instance->rejected;
+		total.notifications += instance->notifications;
+		total.unmatched += instance->unmatched;
+		total.activeSamples += instance->activeSamples;
+		total.bandSamples += instance->bandSamples;
+		total.relaisSamples += instance->relaisSamples;
+		total.samples += instance->samples;
+		total.errorSq += instance->errorSq;
+		total.steadySamples += instance->steadySamples;
+		total.steadyBandSamples += instance->steadyBandSamples;
+		total.steadyErrorSq += instance->steadyErrorSq;
+		total.cycles += instance->cycles;
+		total.outages += instance->outages;
+		total.offlineMS += instance->offlineMS;
+		total.givenUpSamples += instance->givenUpSamples;
+		modemErrors += instance->modemErrors;
+		maxPulseMS = std::max(maxPulseMS, instance->maxPulseMS);
+
+		if(Fleet.perInstance)
+		{
+			std::vector<unsigned long> latency(instance->answerLatency);
+
+			std::sort(latency.begin(), latency.end());
+			printf("%3d  %8lu %8lu %5lu  %8lu  %8.1f s  %5.2f  %5.1f  %10.1f  %10lu  %12lu\n", i, instanceOwner,
+				(unsigned long)instance->answerLatency.size(), instanceLost, instance->rejected, Percentile(latency, 0.95) / 1000.0,
+				instance->activeSamples ? sqrt(instance->errorSq / instance->activeSamples) : 0,
+				Share(instance->bandSamples, instance->activeSamples), (double)instance->cycles / Fleet.days,
+				instance->modemErrors, instance->givenUpSamples * FLEET_SAMPLE_MS / 60000);
+		}
+
+		total.readLatency.insert(total.readLatency.end(), instance->readLatency.begin(), instance->readLatency.end());
+		total.answerLatency.insert(total.answerLatency.end(), instance->answerLatency.begin(), instance->answerLatency.end());
+	}
+
+	printf("\nFleet  %d instances x %d days, loop %lu ms, millis() %lu us: %.1f s, %.2f s per instance day\n", Fleet.count, Fleet.days,
+		Fleet.loopMS, Fleet.callUS, pWallS, pWallS / (Fleet.count * Fleet.days));
+
+	printf("SMS    %lu requests: answered %lu, lost %lu (%.2f%%), rejected %lu (%.2f%%), pending %lu\n", owner + total.rejected,
+		answered, lost, Share(lost, owner + total.rejected), total.rejected, Share(total.rejected, owner + total.rejected), pending);
+	printf("       %lu from a stranger, %lu notifications, %lu answers without a request\n", stranger, total.notifications, total.unmatched);
+	PrintLatency("read", total.readLatency);
+	PrintLatency("answer", total.answerLatency);
+
+	printf("Control  ON %.1f%% of the time: RMS error %.2f C, within %.1f C %.1f%%\n", Share(total.activeSamples, total.samples),
+		total.activeSamples ? sqrt(total.errorSq / total.activeSamples) : 0, FLEET_BAND, Share(total.bandSamples, total.activeSamples));
+	printf("         setpoint reached %.1f%% of the ON time: RMS error %.2f C, within %.1f C %.1f%%\n", Share(total.steadySamples, total.activeSamples),
+		total.steadySamples ? sqrt(total.steadyErrorSq / total.steadySamples) : 0, FLEET_BAND, Share(total.steadyBandSamples, total.steadySamples));
+	printf("         relais duty %.1f%%, %.1f cycles/day, longest coil pulse %lu ms\n", Share(total.relaisSamples, total.samples),
+		(double)total.cycles / (Fleet.count * Fleet.days * ZONE_COUNT), maxPulseMS);
+
+	printf("Modem  %lu outages (%lu min offline), %lu recoveries after an error, given up %lu min\n", total.outages,
+		total.offlineMS / 60000, modemErrors, total.givenUpSamples * FLEET_SAMPLE_MS / 60000);
+}
+
+static void Usage(const char *pName)
+{
+	fprintf(stderr, "%s [-n instances] [-j workers] [-d days] [-l loop ms] [-c millis() us] [-r SMS per day] [-o outages per week] [-m outage min] [-s seed] [-i] [-v instance] [-L library]\n", pName);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t workers[FLEET_MAX_WORKERS];
+	std::string library;
+	double start;
+	int opt;
+
+	Fleet.count = 16;
+	Fleet.workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	Fleet.days = 7;
+	Fleet.loopMS = 20;
+	Fleet.callUS = 1000;
+	Fleet.smsPerDay = 24;
+	Fleet.outagesPerWeek = 1;
+	Fleet.outageMS = (unsigned long)1000*60*30;
+	Fleet.seed = 1;
+	Fleet.perInstance = false;
+	Fleet.verbose = -1;
+
+	//Next to the executable
+	library = argv[0];
+	library = library.substr(0, library.find_last_of('/') + 1) + "libThermostatInstance.so";
+	Fleet.library = library.c_str();
+
+	while((opt = getopt(argc, argv, "n:j:d:l:c:r:o:m:s:iv:L:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n':
+				Fleet.count = atoi(optarg);
+				break;
+			case 'j':
+				Fleet.workers = atoi(optarg);
+				break;
+			case 'd':
+				Fleet.days = atoi(optarg);
+				break;
+			case 'l':
+				Fleet.loopMS = strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				Fleet.callUS = strtoul(optarg, NULL, 10);
+				break;
+			case 'r':
+				Fleet.smsPerDay = atof(optarg);
+				break;
+			case 'o':
+				Fleet.outagesPerWeek = atof(optarg);
+				break;
+			case 'm':
+				Fleet.outageMS = strtoul(optarg, NULL, 10) * 60000;
+				break;
+			case 's':
+				Fleet.seed = strtoul(optarg, NULL, 10);
+				break;
+			case 'i':
+				Fleet.perInstance = true;
+				break;
+			case 'v':
+				Fleet.verbose = atoi(optarg);
+				break;
+			case 'L':
+				Fleet.library = optarg;
+				break;
+			default:
+				Usage(argv[0]);
+		}
+	}
+
+	if((Fleet.count < 1) || (Fleet.days < 1) || (Fleet.smsPerDay <= 0) || (Fleet.workers < 1))
+		Usage(argv[0]);
+
+	Fleet.workers = std::min(std::min(Fleet.workers, Fleet.count), FLEET_MAX_WORKERS);
+	Fleet.instances = new TInstance[Fleet.count];
+	pthread_mutex_init(&Fleet.lock, NULL);
+
+	for(int i = 0; i < Fleet.count; i++)
+	{
+		TInstance *instance = &Fleet.instances[i];
+
+		instance->id = i;
+		instance->offline = false;
+		instance->rejected = instance->notifications = instance->unmatched = 0;
+		instance->activeSamples = instance->bandSamples = instance->relaisSamples = instance->samples = 0;
+		instance->errorSq = 0;
+		instance->steadySamples = instance->steadyBandSamples = 0;
+		instance->steadyErrorSq = 0;
+		memset(instance->reached, 0, sizeof(instance->reached));
+		instance->cycles = 0;
+		instance->maxPulseMS = 0;
+		memset(instance->coilOnMS, 0, sizeof(instance->coilOnMS));
+		instance->outages = instance->offlineMS = instance->givenUpSamples = instance->modemErrors = 0;
+	}
+
+	if(!LoadFleet())
+		return 1;
+
+	//Answers are what the traffic is for: owner commands are the most, OFF and the stranger the least
+	Fleet.totalWeight = 0;
+	for(uint8_t i = 0; i < Fleet.instances[0].entry->smsCount(); i++)
+	{
+		char body[HOST_SMS_BODY_SIZE];
+		int weight = 3;
+
+		if((Fleet.instances[0].entry->smsScript(i, body) != HOST_SMS_OWNER) || (strncmp(body, "OFF", 3) == 0))
+			weight = 1;
+
+		Fleet.weights.push_back(weight);
+		Fleet.totalWeight += weight;
+	}
+
+	start = WallSeconds();
+
+	for(int i = 0; i < Fleet.count; i++)
+		StartInstance(&Fleet.instances[i]);
+
+	for(int day = 1; day <= Fleet.days; day++)
+	{
+		int started;
+
+		Fleet.untilMS = day * FLEET_DAY_MS;
+		Fleet.next = 0;
+
+		for(started = 0; started < Fleet.workers; started++)
+			if(pthread_create(&workers[started], NULL, Worker, NULL))
+				break;
+
+		//A worker that could not start leaves its share to the others, or to this thread
+		if(!started)
+			Worker(NULL);
+
+		for(int w = 0; w < started; w++)
+			pthread_join(workers[w], NULL);
+
+		fprintf(stderr, "Day %d/%d  %.1f s\n", day, Fleet.days, WallSeconds() - start);
+	}
+
+	Report(WallSeconds() - start);
+
+	return 0;
+}
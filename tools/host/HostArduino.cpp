@@ -0,0 +1,570 @@
+#include "WProgram.h"
+#include "SoftwareSerial.h"
+#include "EEPROM.h"
+#include <avr/io.h>
+#include <avr/wdt.h>
+
+#include "HostArduino.h"
+
+#define HOST_LINE_SIZE			256
+#define HOST_STREAM_COUNT		4
+#define HOST_FORMAT_SIZE		512
+
+typedef struct _HostStream
+{
+	FILE *stream;
+	int (*put)(char, FILE *);
+	void *udata;
+}THostStream;
+
+static unsigned long long HostClockUS;
+static unsigned long HostCallUS = HOST_CALL_US;
+static uint8_t HostPins[NUM_DIGITAL_PINS];
+
+static THostLineSink HostDebugSink;
+static void *HostDebugContext;
+static char HostLine[HOST_LINE_SIZE];
+static int HostLineLen;
+
+static THostPinHook HostPinHook;
+static void *HostPinContext;
+
+static THostResetHook HostResetHook;
+static void *HostResetContext;
+static boolean HostWatchdogOn;
+static unsigned long HostWatchdogMS;
+static unsigned long long HostWatchdogUS;
+
+static uint8_t HostEEPROMInternal[E2END + 1];
+static uint8_t *HostEEPROM;
+
+static unsigned long HostRandom = 1;
+
+static THostStream HostStreams[HOST_STREAM_COUNT];
+
+volatile uint8_t MCUSR;
+volatile uint8_t SREG;
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint8_t TIMSK1;
+volatile uint8_t TIFR1;
+volatile uint16_t TCNT1;
+
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Virtual clock and watchdog
+////////////////////////////////////////////////////////////////////////////////////
+static void HostTick(unsigned long long pUS)
+{
+	HostClockUS += pUS;
+
+	if(HostWatchdogOn && (HostClockUS >= HostWatchdogUS))
+	{
+		HostWatchdogOn = false;
+
+		if(HostResetHook)
+			HostResetHook(HostResetContext);
+	}
+}
+
+void HostAdvance(unsigned long pMS)
+{
+	HostTick((unsigned long long)pMS * 1000);
+}
+
+unsigned long long HostMicros()
+{
+	return HostClockUS;
+}
+
+unsigned long millis()
+{
+	HostTick(HostCallUS);
+	return (unsigned long)(HostClockUS / 1000);
+}
+
+unsigned long micros()
+{
+	HostTick(HostCallUS);
+	return (unsigned long)HostClockUS;
+}
+
+void HostSetCallCost(unsigned long pUS)
+{
+	HostCallUS = pUS;
+}
+
+void delay(unsigned long pMS)
+{
+	HostAdvance(pMS);
+}
+
+void delayMicroseconds(unsigned int pUS)
+{
+	HostTick(pUS);
+}
+
+void wdt_enable(uint8_t pTimeout)
+{
+	//WDTO_xxx: 16 ms << value
+	HostWatchdogMS = 16UL << pTimeout;
+	HostWatchdogOn = true;
+	wdt_reset();
+}
+
+void wdt_disable()
+{
+	HostWatchdogOn = false;
+}
+
+void wdt_reset()
+{
+	HostWatchdogUS = HostClockUS + (unsigned long long)HostWatchdogMS * 1000;
+}
+
+void HostSetResetHook(THostResetHook pHook, void *pContext)
+{
+	HostResetHook = pHook;
+	HostResetContext = pContext;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Pins: outputs are recorded, inputs read low. The analog input is not wired,
+//	the simulated room sensor computes its own ADC counts
+////////////////////////////////////////////////////////////////////////////////////
+void pinMode(uint8_t pPin, uint8_t pMode)
+{
+}
+
+void digitalWrite(uint8_t pPin, uint8_t pValue)
+{
+	if(pPin >= NUM_DIGITAL_PINS)
+		return;
+
+	HostPins[pPin] = pValue ? HIGH : LOW;
+
+	if(HostPinHook)
+		HostPinHook(HostPinContext, pPin, HostPins[pPin]);
+}
+
+int digitalRead(uint8_t pPin)
+{
+	return LOW;
+}
+
+int analogRead(uint8_t pPin)
+{
+	return 0;
+}
+
+uint8_t HostPinValue(uint8_t pPin)
+{
+	return (pPin < NUM_DIGITAL_PINS) ? HostPins[pPin] : LOW;
+}
+
+void HostSetPinHook(THostPinHook pHook, void *pContext)
+{
+	HostPinHook = pHook;
+	HostPinContext = pContext;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+//	avr-libc random(): Park-Miller minimal standard, same sequence per seed
+////////////////////////////////////////////////////////////////////////////////////
+static long HostNextRandom()
+{
+	long hi = HostRandom / 127773L;
+	long lo = HostRandom % 127773L;
+	long x = 16807L * lo - 2836L * hi;
+
+	if(x <= 0)
+		x += 0x7FFFFFFFL;
+
+	return (long)(HostRandom = x);
+}
+
+long random(long pMax)
+{
+	return pMax ? HostNextRandom() % pMax : 0;
+}
+
+long random(long pMin, long pMax)
+{
+	return (pMin >= pMax) ? pMin : pMin + random(pMax - pMin);
+}
+
+void randomSeed(unsigned int pSeed)
+{
+	HostSeed(pSeed);
+}
+
+void HostSeed(unsigned long pSeed)
+{
+	HostRandom = (pSeed % 0x7FFFFFFEUL) + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+//	avr-libc extras
+////////////////////////////////////////////////////////////////////////////////////
+char *dtostrf(double pValue, signed char pWidth, unsigned char pPrecision, char *pDest)
+{
+	sprintf(pDest, "%*.*f", pWidth, pPrecision, pValue);
+	return pDest;
+}
+
+char *strupr(char *pStr)
+{
+	for(char *p = pStr; *p; p++)
+		if((*p >= 'a') && (*p <= 'z'))
+			*p -= 'a' - 'A';
+
+	return pStr;
+}
+
+//%S is a string in flash for avr-libc, a wide string for glibc
+static const char *HostFormat(PGM_P pFmt, char *pDest)
+{
+	int i = 0;
+
+	for(const char *p = pFmt; *p && (i < HOST_FORMAT_SIZE - 1); p++)
+	{
+		pDest[i++] = *p;
+
+		if(*p == '%')
+		{
+			for(p++; *p && strchr("-+ #0123456789.lh", *p) && (i < HOST_FORMAT_SIZE - 2); p++)
+				pDest[i++] = *p;
+
+			if(!*p)
+				break;
+
+			pDest[i++] = (*p == 'S') ? 's' : *p;
+		}
+	}
+
+	pDest[i] = '\0';
+	return pDest;
+}
+
+int vsnprintf_P(char *pDest, size_t pSize, PGM_P pFmt, va_list pArgs)
+{
+	char fmt[HOST_FORMAT_SIZE];
+
+	return vsnprintf(pDest, pSize, HostFormat(pFmt, fmt), pArgs);
+}
+
+int snprintf_P(char *pDest, size_t pSize, PGM_P pFmt, ...)
+{
+	va_list args;
+	int res;
+
+	va_start(args, pFmt);
+	res = vsnprintf_P(pDest, pSize, pFmt, args);
+	va_end(args);
+
+	return res;
+}
+
+int sprintf_P(char *pDest, PGM_P pFmt, ...)
+{
+	va_list args;
+	int res;
+
+	va_start(args, pFmt);
+	res = vsnprintf_P(pDest, HOST_FORMAT_SIZE, pFmt, args);
+	va_end(args);
+
+	return res;
+}
+
+static THostStream *HostFindStream(FILE *pStream, boolean pCreate)
+{
+	for(byte i = 0; i < HOST_STREAM_COUNT; i++)
+		if(HostStreams[i].stream == pStream)
+			return &HostStreams[i];
+
+	if(pCreate)
+		for(byte i = 0; i < HOST_STREAM_COUNT; i++)
+			if(!HostStreams[i].stream)
+			{
+				HostStreams[i].stream = pStream;
+				return &HostStreams[i];
+			}
+
+	return NULL;
+}
+
+void fdev_setup_stream(FILE *pStream, int (*pPut)(char, FILE *), int (*pGet)(FILE *), int pFlags)
+{
+	THostStream *stream = HostFindStream(pStream, true);
+
+	if(stream)
+		stream->put = pPut;
+}
+
+void fdev_set_udata(FILE *pStream, void *pData)
+{
+	THostStream *stream = HostFindStream(pStream, true);
+
+	if(stream)
+		stream->udata = pData;
+}
+
+void *fdev_get_udata(FILE *pStream)
+{
+	THostStream *stream = HostFindStream(pStream, false);
+
+	return stream ? stream->udata : NULL;
+}
+
+int vfprintf_P(FILE *pStream, PGM_P pFmt, va_list pArgs)
+{
+	THostStream *stream = HostFindStream(pStream, false);
+	char fmt[HOST_FORMAT_SIZE];
+	char text[HOST_FORMAT_SIZE];
+	int len;
+
+	if(!stream || !stream->put)
+		return vfprintf(pStream, HostFormat(pFmt, fmt), pArgs);
+
+	len = vsnprintf(text, sizeof(text), HostFormat(pFmt, fmt), pArgs);
+
+	for(int i = 0; (i < len) && (i < (int)sizeof(text) - 1); i++)
+		stream->put(text[i], pStream);
+
+	return len;
+}
+
+int fprintf_P(FILE *pStream, PGM_P pFmt, ...)
+{
+	va_list args;
+	int res;
+
+	va_start(args, pFmt);
+	res = vfprintf_P(pStream, pFmt, args);
+	va_end(args);
+
+	return res;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Print and the serial ports
+////////////////////////////////////////////////////////////////////////////////////
+void Print::write(const char *pStr)
+{
+	for(; *pStr; pStr++)
+		write((uint8_t)*pStr);
+}
+
+void Print::write(const uint8_t *pBuffer, size_t pSize)
+{
+	for(size_t i = 0; i < pSize; i++)
+		write(pBuffer[i]);
+}
+
+void Print::print(const char *pStr)
+{
+	write(pStr);
+}
+
+void Print::print(char c, int pBase)
+{
+	print((long)c, pBase);
+}
+
+void Print::print(unsigned char c, int pBase)
+{
+	print((unsigned long)c, pBase);
+}
+
+void Print::print(int n, int pBase)
+{
+	print((long)n, pBase);
+}
+
+void Print::print(unsigned int n, int pBase)
+{
+	print((unsigned long)n, pBase);
+}
+
+void Print::print(long n, int pBase)
+{
+	if((pBase != BYTE) && (n < 0))
+	{
+		write('-');
+		n = -n;
+	}
+
+	print((unsigned long)n, pBase);
+}
+
+void Print::print(unsigned long n, int pBase)
+{
+	char buf[24];
+
+	if(pBase == BYTE)
+	{
+		write((uint8_t)n);
+		return;
+	}
+
+	snprintf(buf, sizeof(buf), (pBase == HEX) ? "%lX" : "%lu", n);
+	write(buf);
+}
+
+void Print::print(double n, int pDigits)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%.*f", pDigits, n);
+	write(buf);
+}
+
+void Print::println()
+{
+	write("\r\n");
+}
+
+void Print::println(const char *pStr)
+{
+	print(pStr);
+	println();
+}
+
+void Print::println(char c, int pBase)
+{
+	print(c, pBase);
+	println();
+}
+
+void Print::println(int n, int pBase)
+{
+	print(n, pBase);
+	println();
+}
+
+void Print::println(unsigned int n, int pBase)
+{
+	print(n, pBase);
+	println();
+}
+
+void Print::println(long n, int pBase)
+{
+	print(n, pBase);
+	println();
+}
+
+void Print::println(unsigned long n, int pBase)
+{
+	print(n, pBase);
+	println();
+}
+
+void Print::println(double n, int pDigits)
+{
+	print(n, pDigits);
+	println();
+}
+
+void HardwareSerial::begin(long pBaud)
+{
+}
+
+void HardwareSerial::end()
+{
+}
+
+int HardwareSerial::available()
+{
+	return 0;
+}
+
+int HardwareSerial::read()
+{
+	return -1;
+}
+
+int HardwareSerial::peek()
+{
+	return -1;
+}
+
+void HardwareSerial::flush()
+{
+}
+
+void HardwareSerial::write(uint8_t c)
+{
+}
+
+SoftwareSerial::SoftwareSerial(uint8_t pRXPin, uint8_t pTXPin)
+{
+}
+
+void SoftwareSerial::begin(long pBaud)
+{
+}
+
+int SoftwareSerial::read()
+{
+	return -1;
+}
+
+//Lines are passed to the sink without the line break
+void SoftwareSerial::write(uint8_t c)
+{
+	if(c == '\r')
+		return;
+
+	if((c == '\n') || (HostLineLen == HOST_LINE_SIZE - 1))
+	{
+		HostLine[HostLineLen] = '\0';
+		HostLineLen = 0;
+
+		if(HostDebugSink)
+			HostDebugSink(HostDebugContext, HostLine);
+
+		if(c == '\n')
+			return;
+	}
+
+	HostLine[HostLineLen++] = c;
+}
+
+void HostSetDebugSink(THostLineSink pSink, void *pContext)
+{
+	HostDebugSink = pSink;
+	HostDebugContext = pContext;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+//	EEPROM
+////////////////////////////////////////////////////////////////////////////////////
+void HostSetEEPROM(uint8_t *pImage)
+{
+	if(!(HostEEPROM = pImage))
+	{
+		memset(HostEEPROMInternal, 0xFF, sizeof(HostEEPROMInternal));
+		HostEEPROM = HostEEPROMInternal;
+	}
+}
+
+uint8_t EEPROMClass::read(int pAddress)
+{
+	if(!HostEEPROM)
+		HostSetEEPROM(NULL);
+
+	return ((pAddress >= 0) && (pAddress <= E2END)) ? HostEEPROM[pAddress] : 0xFF;
+}
+
+void EEPROMClass::write(int pAddress, uint8_t pValue)
+{
+	if(!HostEEPROM)
+		HostSetEEPROM(NULL);
+
+	if((pAddress >= 0) && (pAddress <= E2END))
+		HostEEPROM[pAddress] = pValue;
+}
@@ -0,0 +1,42 @@
+#ifndef __HOST_ARDUINO
+#define __HOST_ARDUINO
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Host side of the Arduino core build (arduino/): the harness drives the
+//	virtual clock and collects the sketch output through these calls.
+//
+//	The clock only moves when the sketch asks for it: every millis() or
+//	micros() call costs HOST_CALL_US (or HostSetCallCost()), delay() and
+//	delayMicroseconds() advance it by their argument, and the harness adds the
+//	idle time of a loop() pass with HostAdvance(). Busy waits on millis() therefore end, and timers,
+//	timeouts and the room model all run on the same time base.
+//
+//	All the state is per process image: one sketch instance per executable, or
+//	per loaded copy of the instance library (see FleetSim.cpp)
+////////////////////////////////////////////////////////////////////////////////////
+
+#define HOST_CALL_US			100			//Virtual CPU time of a millis() call
+
+typedef void (*THostLineSink)(void *pContext, const char *pLine);
+typedef void (*THostPinHook)(void *pContext, uint8_t pPin, uint8_t pValue);
+typedef void (*THostResetHook)(void *pContext);
+
+extern void HostAdvance(unsigned long pMS);
+extern unsigned long long HostMicros();
+
+//Debug port lines, without the line break. NULL discards them
+extern void HostSetDebugSink(THostLineSink pSink, void *pContext);
+//Called on every digitalWrite()
+extern void HostSetPinHook(THostPinHook pHook, void *pContext);
+//Called when the watchdog expires. It must not return: the instance is reset
+extern void HostSetResetHook(THostResetHook pHook, void *pContext);
+//EEPROM image, E2END + 1 bytes kept by the caller across resets. NULL: internal, erased
+extern void HostSetEEPROM(uint8_t *pImage);
+extern void HostSeed(unsigned long pSeed);
+//Virtual time of a millis() or micros() call. Busy waits poll fewer times when it is larger
+extern void HostSetCallCost(unsigned long pUS);
+
+extern uint8_t HostPinValue(uint8_t pPin);
+
+#endif
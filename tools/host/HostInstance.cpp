@@ -0,0 +1,109 @@
+#include "PinConfig.h"
+
+//The room model instead of the configured sensor
+#undef TEMP_SENSOR_CLASS
+#define TEMP_SENSOR_CLASS		TempSensorSim
+
+#include "GSMThermostat.cpp"
+
+#include "HostInstance.h"
+
+static unsigned long HostLoopMS;
+
+//The drivers see the fake modem through HostInstance.h only
+typedef char THostBodySizeCheck[(HOST_SMS_BODY_SIZE == FAKE_MODEM_BODY_SIZE) ? 1 : -1];
+typedef char THostSlotsCheck[(HOST_SMS_SLOTS == FAKE_MODEM_SMS_SLOTS) ? 1 : -1];
+typedef char THostEventCheck[((int)hmeSent == (int)FakeModemSerial::feSent) ? 1 : -1];
+
+void HostStart(const THostConfig *pConfig)
+{
+	HostSeed(pConfig->seed);
+	HostSetEEPROM(pConfig->eeprom);
+	HostSetDebugSink(pConfig->debugSink, pConfig->debugContext);
+	HostLoopMS = pConfig->loopMS;
+	HostSetCallCost(pConfig->callUS ? pConfig->callUS : HOST_CALL_US);
+
+	if(!pConfig->scriptedSMS)
+		FakeModem.StopScript();
+
+	setup();
+}
+
+void HostRun(unsigned long pUntilMS)
+{
+	while(HostNow() < pUntilMS)
+	{
+		loop();
+		HostAdvance(HostLoopMS);
+	}
+}
+
+unsigned long HostNow()
+{
+	return (unsigned long)(HostMicros() / 1000);
+}
+
+void HostSample(THostSample *pSample)
+{
+	pSample->zoneCount = (ZONE_COUNT < HOST_MAX_ZONES) ? ZONE_COUNT : HOST_MAX_ZONES;
+
+	for(byte z = 0; z < pSample->zoneCount; z++)
+	{
+		pSample->zone[z].active = Active[z];
+		pSample->zone[z].relais = Relais[z].IsSet();
+		pSample->zone[z].temp = LastTemp[z];
+		pSample->zone[z].tempSet = TempSet[z];
+	}
+
+	pSample->modemGivenUp = ModemGivenUp;
+	pSample->modemErrors = Status.resetCount;
+}
+
+uint8_t HostDeliverSMS(uint8_t pIndex)
+{
+	return FakeModem.Deliver(pIndex);
+}
+
+uint8_t HostSMSCount()
+{
+	return FakeModem.ScriptCount();
+}
+
+uint8_t HostSMSScript(uint8_t pIndex, char *pBody)
+{
+	char phone[FAKE_MODEM_NUMBER_SIZE];
+
+	FakeModem.ScriptSMS(pIndex, phone, pBody);
+
+	return strcmp(phone, FAKE_MODEM_OWNER) ? HOST_SMS_STRANGER : HOST_SMS_OWNER;
+}
+
+void HostSetModemOffline(bool pOffline)
+{
+	FakeModem.SetOffline(pOffline);
+}
+
+void HostSetModemHook(THostModemHook pHook, void *pContext)
+{
+	FakeModem.SetHook(pHook, pContext);
+}
+
+//Found with dlsym() in every loaded copy of the instance library
+extern "C" const THostEntry *HostEntry()
+{
+	static const THostEntry entry =
+	{
+		HostStart,
+		HostRun,
+		HostNow,
+		HostSample,
+		HostDeliverSMS,
+		HostSMSCount,
+		HostSMSScript,
+		HostSetModemOffline,
+		HostSetModemHook,
+		HostSetPinHook
+	};
+
+	return &entry;
+}
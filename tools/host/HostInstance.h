@@ -0,0 +1,83 @@
+#ifndef __HOST_INSTANCE
+#define __HOST_INSTANCE
+#include "HostArduino.h"
+
+////////////////////////////////////////////////////////////////////////////////////
+//	One sketch instance on the virtual clock: the sketch built for the host
+//	with FakeModemSerial as the modem and TempSensorSim as the sensors.
+//	HostStart() runs setup(), HostRun() runs loop() until the given time, 
+//	adding loopMS of idle time after every pass.
+//
+//	The test drivers look into the instance through HostSample() and drive the
+//	fake modem through HostDeliverSMS(), HostSetModemOffline() and the modem
+//	hook. Built as a shared library the instance exports HostEntry(): the
+//	same calls, for a driver that loads one copy of the library per instance
+////////////////////////////////////////////////////////////////////////////////////
+
+#define HOST_MAX_ZONES			4
+#define HOST_SMS_BODY_SIZE		16			//FAKE_MODEM_BODY_SIZE
+#define HOST_SMS_SLOTS			10			//FAKE_MODEM_SMS_SLOTS, the slots are 1 to HOST_SMS_SLOTS
+#define HOST_SMS_OWNER			0			//HostSMSScript(): from the MAINPHONE entry
+#define HOST_SMS_STRANGER		1			//Not in the phonebook, no answer
+
+//FakeModemSerial::EEvent
+typedef enum _HostModemEvent {hmeRead, hmeStored, hmeSent} EHostModemEvent;
+typedef void (*THostModemHook)(void *pContext, uint8_t pEvent, uint8_t pSlot, const char *pText);
+
+typedef struct _HostConfig
+{
+	unsigned long seed;						//random(): sensor noise
+	unsigned long loopMS;					//Idle time of a loop() pass, on top of the millis() calls
+	unsigned long callUS;					//Virtual time of a millis() call, 0: HOST_CALL_US
+	bool scriptedSMS;						//FakeModemSerial delivers its SMS script
+	THostLineSink debugSink;				//Debug port lines, NULL discards them
+	void *debugContext;
+	uint8_t *eeprom;						//E2END + 1 bytes, NULL: erased
+}THostConfig;
+
+typedef struct _HostZoneSample
+{
+	bool active;
+	bool relais;
+	float temp;								//As read by the sketch
+	float tempSet;
+}THostZoneSample;
+
+typedef struct _HostSample
+{
+	uint8_t zoneCount;
+	THostZoneSample zone[HOST_MAX_ZONES];
+	bool modemGivenUp;
+	uint8_t modemErrors;					//Recoveries after a modem error (Status.resetCount)
+}THostSample;
+
+extern void HostStart(const THostConfig *pConfig);
+extern void HostRun(unsigned long pUntilMS);
+extern unsigned long HostNow();
+extern void HostSample(THostSample *pSample);
+
+//Scripted SMS pIndex (FakeModemSerial) from the network: the slot, 0 if the SIM memory is full
+extern uint8_t HostDeliverSMS(uint8_t pIndex);
+extern uint8_t HostSMSCount();
+//Text of the scripted SMS pIndex, returns HOST_SMS_OWNER or HOST_SMS_STRANGER
+extern uint8_t HostSMSScript(uint8_t pIndex, char *pBody);
+extern void HostSetModemOffline(bool pOffline);
+extern void HostSetModemHook(THostModemHook pHook, void *pContext);
+
+typedef struct _HostEntry
+{
+	void (*start)(const THostConfig *pConfig);
+	void (*run)(unsigned long pUntilMS);
+	unsigned long (*now)();
+	void (*sample)(THostSample *pSample);
+	uint8_t (*deliverSMS)(uint8_t pIndex);
+	uint8_t (*smsCount)();
+	uint8_t (*smsScript)(uint8_t pIndex, char *pBody);
+	void (*setModemOffline)(bool pOffline);
+	void (*setModemHook)(THostModemHook pHook, void *pContext);
+	void (*setPinHook)(THostPinHook pHook, void *pContext);
+}THostEntry;
+
+extern "C" const THostEntry *HostEntry();
+
+#endif
@@ -0,0 +1,7 @@
+#include "MemoryInfo.h"
+
+//MemoryInfo.cpp reads the avr-libc heap and the painted stack, there is nothing like it on the host
+void GetMemoryInfo(TMemoryInfo *pInfo)
+{
+	memset(pInfo, 0, sizeof(*pInfo));
+}
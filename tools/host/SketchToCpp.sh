@@ -0,0 +1,21 @@
+#!/bin/sh
+# Turns the sketch into a C++ translation unit, as the Arduino IDE does before
+# compiling it: WProgram.h first, then the sketch with a prototype of every
+# function defined in it, placed before the first definition.
+#
+#     SketchToCpp.sh <sketch.pde> <output.cpp>
+
+PDE="$1"
+OUT="$2"
+SIGNATURE='^[A-Za-z_][A-Za-z0-9_ *<>:,]* +\**[A-Za-z_][A-Za-z0-9_]*\(.*\)\s*$'
+
+first=$(grep -nE "$SIGNATURE" "$PDE" | grep -v ';' | head -1 | cut -d: -f1)
+
+{
+	echo '#include "WProgram.h"'
+	echo "#line 1 \"$PDE\""
+	head -n $((first - 1)) "$PDE"
+	grep -E "$SIGNATURE" "$PDE" | grep -v ';' | sed 's/$/;/'
+	echo "#line $first \"$PDE\""
+	tail -n +$first "$PDE"
+} > "$OUT"
@@ -0,0 +1,14 @@
+#ifndef __HOST_EEPROM
+#define __HOST_EEPROM
+#include <stdint.h>
+
+class EEPROMClass
+{
+public:
+	uint8_t read(int pAddress);
+	void write(int pAddress, uint8_t pValue);
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
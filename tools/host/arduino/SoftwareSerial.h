@@ -0,0 +1,17 @@
+#ifndef __HOST_SOFTWARE_SERIAL
+#define __HOST_SOFTWARE_SERIAL
+#include "WProgram.h"
+
+//The sketch debug port: lines written to it go to the host debug sink
+class SoftwareSerial : public Print
+{
+public:
+	SoftwareSerial(uint8_t pRXPin, uint8_t pTXPin);
+
+	void begin(long pBaud);
+	int read();
+	virtual void write(uint8_t c);
+	using Print::write;
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef __HOST_WPROGRAM
+#define __HOST_WPROGRAM
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Host build of the Arduino 0022 core subset used by the sketch. Time is
+//	virtual: see HostArduino.cpp
+////////////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <math.h>
+#include <avr/pgmspace.h>
+
+typedef uint8_t boolean;
+typedef uint8_t byte;
+
+#define HIGH				0x1
+#define LOW					0x0
+#define INPUT				0x0
+#define OUTPUT				0x1
+
+#define DEC					10
+#define HEX					16
+#define BYTE				0
+
+#define E2END				0x3FF		//ATmega328
+#define A0					14
+#define A1					15
+#define A2					16
+#define A3					17
+#define A4					18
+#define A5					19
+#define NUM_DIGITAL_PINS	20
+
+#ifndef min
+  #define min(a,b)			((a)<(b)?(a):(b))
+  #define max(a,b)			((a)>(b)?(a):(b))
+#endif
+
+#define noInterrupts()
+#define interrupts()
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long pMS);
+void delayMicroseconds(unsigned int pUS);
+
+void pinMode(uint8_t pPin, uint8_t pMode);
+void digitalWrite(uint8_t pPin, uint8_t pValue);
+int digitalRead(uint8_t pPin);
+int analogRead(uint8_t pPin);
+
+long random(long pMax);
+long random(long pMin, long pMax);
+void randomSeed(unsigned int pSeed);
+
+char *dtostrf(double pValue, signed char pWidth, unsigned char pPrecision, char *pDest);
+char *strupr(char *pStr);
+
+class Print
+{
+public:
+	virtual ~Print() {};
+	virtual void write(uint8_t c) = 0;
+	virtual void write(const char *pStr);
+	virtual void write(const uint8_t *pBuffer, size_t pSize);
+
+	void print(const char *pStr);
+	void print(char c, int pBase = BYTE);
+	void print(unsigned char c, int pBase = BYTE);
+	void print(int n, int pBase = DEC);
+	void print(unsigned int n, int pBase = DEC);
+	void print(long n, int pBase = DEC);
+	void print(unsigned long n, int pBase = DEC);
+	void print(double n, int pDigits = 2);
+
+	void println();
+	void println(const char *pStr);
+	void println(char c, int pBase = BYTE);
+	void println(int n, int pBase = DEC);
+	void println(unsigned int n, int pBase = DEC);
+	void println(long n, int pBase = DEC);
+	void println(unsigned long n, int pBase = DEC);
+	void println(double n, int pDigits = 2);
+};
+
+//The serial ports have no peer on the host: output goes to the debug sink, nothing is received
+class HardwareSerial : public Print
+{
+public:
+	void begin(long pBaud);
+	void end();
+	int available();
+	int read();
+	int peek();
+	void flush();
+	virtual void write(uint8_t c);
+	using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef __HOST_AVR_INTERRUPT
+#define __HOST_AVR_INTERRUPT
+
+#define ISR(vector)			void vector(void)
+#define cli()
+#define sei()
+
+#endif
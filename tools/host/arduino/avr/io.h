@@ -0,0 +1,21 @@
+#ifndef __HOST_AVR_IO
+#define __HOST_AVR_IO
+#include <stdint.h>
+
+#define _BV(bit)			(1 << (bit))
+
+//Registers touched by the sketch (watchdog flags and the PROFILE timer), plain memory on the host
+extern volatile uint8_t MCUSR;
+extern volatile uint8_t SREG;
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint8_t TIMSK1;
+extern volatile uint8_t TIFR1;
+extern volatile uint16_t TCNT1;
+
+#define WDRF				3
+#define CS10				0
+#define TOIE1				0
+#define TOV1				0
+
+#endif
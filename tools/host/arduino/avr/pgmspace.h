@@ -0,0 +1,56 @@
+#ifndef __HOST_AVR_PGMSPACE
+#define __HOST_AVR_PGMSPACE
+
+////////////////////////////////////////////////////////////////////////////////////
+//	Flash and RAM are one address space on the host: the _P functions are the
+//	plain ones. The printf family also takes %S (string in flash) as avr-libc
+//	does, and writes to streams set up with fdev_setup_stream()
+////////////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+
+#define PROGMEM
+#define PSTR(s)				(s)
+
+typedef const char *PGM_P;
+typedef char prog_char;
+typedef unsigned char prog_uchar;
+typedef int8_t prog_int8_t;
+typedef uint8_t prog_uint8_t;
+typedef int16_t prog_int16_t;
+typedef uint16_t prog_uint16_t;
+typedef uint32_t prog_uint32_t;
+
+#define pgm_read_byte(p)	(*(const uint8_t *)(p))
+#define pgm_read_word(p)	(*(const uint16_t *)(p))
+#define pgm_read_dword(p)	(*(const uint32_t *)(p))
+
+#define memcpy_P			memcpy
+#define strcpy_P			strcpy
+#define strncpy_P			strncpy
+#define strcat_P			strcat
+#define strcmp_P			strcmp
+#define strncmp_P			strncmp
+#define strcasecmp_P		strcasecmp
+#define strncasecmp_P		strncasecmp
+#define strlen_P			strlen
+#define strstr_P			strstr
+#define sscanf_P			sscanf
+
+int sprintf_P(char *pDest, PGM_P pFmt, ...);
+int snprintf_P(char *pDest, size_t pSize, PGM_P pFmt, ...);
+int vsnprintf_P(char *pDest, size_t pSize, PGM_P pFmt, va_list pArgs);
+int fprintf_P(FILE *pStream, PGM_P pFmt, ...);
+int vfprintf_P(FILE *pStream, PGM_P pFmt, va_list pArgs);
+
+//avr-libc user streams, the FILE is only a key to the put function and the user data
+#define _FDEV_SETUP_WRITE	2
+
+void fdev_setup_stream(FILE *pStream, int (*pPut)(char, FILE *), int (*pGet)(FILE *), int pFlags);
+void fdev_set_udata(FILE *pStream, void *pData);
+void *fdev_get_udata(FILE *pStream);
+
+#endif
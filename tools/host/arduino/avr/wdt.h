@@ -0,0 +1,14 @@
+#ifndef __HOST_AVR_WDT
+#define __HOST_AVR_WDT
+
+#define WDTO_1S				6
+#define WDTO_2S				7
+#define WDTO_4S				8
+#define WDTO_8S				9
+
+//The watchdog runs on the virtual clock, an expiry is a reset of the instance (HostArduino.cpp)
+void wdt_enable(uint8_t pTimeout);
+void wdt_disable();
+void wdt_reset();
+
+#endif